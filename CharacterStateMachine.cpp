@@ -1,9 +1,50 @@
 // Fill out your copyright notice in the Description page of Project Settings.
 
 #include "CharacterStateMachine.h"
+#include "CharacterStateMachineSubsystem.h"
 #include "StateComponentBase.h"
+#include "StateMachineConfig.h"
+#include "StateMachineSharedPool.h"
+#include "Camera/PlayerCameraManager.h"
+#include "GameFramework/Character.h"
+#include "GameFramework/CharacterMovementComponent.h"
 #include "Kismet/GameplayStatics.h"
+#include "Misc/Paths.h"
+#include "UObject/UObjectIterator.h"
 
+#if WITH_EDITOR
+#include "Misc/DataValidation.h"
+#endif
+
+DECLARE_CYCLE_STAT(TEXT("Setup State Machine"), STAT_SetupStateMachine, STATGROUP_CharacterStateMachine);
+DECLARE_CYCLE_STAT(TEXT("Reset State Machine For Reuse"), STAT_ResetStateMachineForReuse, STATGROUP_CharacterStateMachine);
+
+//Where each mechanic lives on an owner class. Found once per class and shared by every instance of it, so spawning more of the
+//same character only reads a pointer per mechanic instead of looking each one up by name.
+struct FStateMechanicArchetype
+{
+	//Object property holding the mechanic of each state. Null where the owner class has none, those fall back to the name lookup.
+	FObjectPropertyBase* Properties[NumCharacterStates] = {};
+};
+
+namespace
+{
+	//Game thread only, like SetupStateMachine.
+	TMap<TWeakObjectPtr<const UClass>, FStateMechanicArchetype> MechanicArchetypes;
+
+	uint32 HashDefinition(const FCharacterStateMachineDefinition& Definition)
+	{
+		uint32 Hash = HashCombine(GetTypeHash(Definition.AssignedMask), GetTypeHash(Definition.GuardedMask));
+		Hash = HashCombine(Hash, GetTypeHash(Definition.NumBound | Definition.NumRegions << 16));
+		Hash = FCrc::MemCrc32(Definition.Table.Rows, sizeof(Definition.Table.Rows), Hash);
+		Hash = FCrc::MemCrc32(Definition.PriorityOrder, sizeof(Definition.PriorityOrder), Hash);
+		Hash = FCrc::MemCrc32(Definition.RegionOf, sizeof(Definition.RegionOf), Hash);
+		return FCrc::MemCrc32(Definition.RequiredGuards, sizeof(Definition.RequiredGuards), Hash);
+	}
+
+	//Every distinct definition a machine is set up with. Game thread only, like SetupStateMachine.
+	TStateMachineSharedPool<FCharacterStateMachineDefinition, &HashDefinition> SharedDefinitions;
+}
 
 // Sets default values for this component's properties
 UCharacterStateMachine::UCharacterStateMachine()
@@ -19,6 +60,30 @@ UCharacterStateMachine::UCharacterStateMachine()
 void UCharacterStateMachine::BeginPlay()
 {
 	Super::BeginPlay();
+
+	TraceRecorder.Initialize(TraceCapacity);
+	LODPhase = static_cast<uint8>(GetUniqueID());
+	LastUpdateTime = GetWorld()->GetTimeSeconds();
+
+	if (UseBatchedUpdate)
+	{
+		if (UCharacterStateMachineSubsystem* Subsystem = UWorld::GetSubsystem<UCharacterStateMachineSubsystem>(GetWorld()))
+		{
+			Subsystem->RegisterMachine(*this);
+		}
+	}
+}
+
+void UCharacterStateMachine::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (IsBatched())
+	{
+		BatchSubsystem->UnregisterMachine(*this);
+	}
+	//The definition is freed with the last machine using it, at the latest when play in editor ends.
+	ReleaseSharedDefinition();
+
+	Super::EndPlay(EndPlayReason);
 }
 
 
@@ -32,102 +97,488 @@ void UCharacterStateMachine::TickComponent(float DeltaTime, ELevelTick TickType,
 
 bool UCharacterStateMachine::SetState(const ECharacterState& NewStateEnum)
 {
-	UStateComponentBase* TranslatedState = TranslateEnumToState(NewStateEnum);
+	if (!Detecting) ExternalRequestMask |= StateMachineCore::StateBit(NewStateEnum);
 
-	//If OnSetStateCondition returns false, it means the conditions are not meant for the new state, thus aborting switching state.
-	if (TranslatedState == nullptr || !TranslatedState->OnSetStateConditionCheck(*this))
+	if (DeferTransitions)
 	{
-		if (DebugStateMachine && GEngine)
+		//A request that can never apply fails here, only guards, conditions and priority wait for the commit.
+		const StateMachineCore::ESetStateResult Result = Core.CheckRequest(NewStateEnum);
+		if (Result != StateMachineCore::ESetStateResult::Entered)
 		{
-			if (TranslatedState == nullptr)
-			{
-				GEngine->AddOnScreenDebugMessage(-1, 1, FColor::Red, EnumToString(NewStateEnum) + " is not assigned. Cant switch state");
-			}
-			else
-			{
-				GEngine->AddOnScreenDebugMessage(-1, 1, FColor::Red, "Conditions are not met for " + EnumToString(NewStateEnum));
-			}
+			ReportRejectedRequest(NewStateEnum, Result);
+			return false;
+		}
+		RequestState(NewStateEnum);
+		return true;
+	}
+	return ApplyState(NewStateEnum) == StateMachineCore::ESetStateResult::Entered;
+}
+
+void UCharacterStateMachine::RequestState(const ECharacterState& NewStateEnum)
+{
+	if (!Detecting) ExternalRequestMask |= StateMachineCore::StateBit(NewStateEnum);
+	else DetectorRequested = true;
+
+	//Requests are coalesced into a mask, asking for the same state twice in a frame is a single request.
+	const bool WasEmpty = PendingRequestMask == 0;
+	PendingRequestMask |= StateMachineCore::StateBit(NewStateEnum);
+	TraceRecorder.Record(EStateTraceEvent::Request, TraceStateIndex(NewStateEnum), static_cast<uint8>(NewStateEnum));
+
+	if (WasEmpty && IsBatched())
+	{
+		BatchSubsystem->MarkPendingCommit(*this);
+	}
+}
+
+void UCharacterStateMachine::CommitTransitions()
+{
+	if (PendingRequestMask == 0) return;
+
+	//Cleared up front, requests made while entering the winner wait for the next commit.
+	const uint64 Requests = PendingRequestMask;
+	PendingRequestMask = 0;
+
+	//Each region gets one winner, regions are independent of each other.
+	uint32 AppliedRegions = 0;
+	for (int32 Index = 0; Index < Core.GetNumBound(); ++Index)
+	{
+		const ECharacterState State = Core.GetBoundEnum(Index);
+		if ((Requests & StateMachineCore::StateBit(State)) == 0) continue;
+
+		const uint32 RegionBit = 1u << Core.GetRegionOf(State);
+		if ((AppliedRegions & RegionBit) != 0)
+		{
+			ReportRejectedRequest(State, StateMachineCore::ESetStateResult::Superseded);
+			continue;
+		}
+
+		const StateMachineCore::ESetStateResult Result = ApplyState(State);
+		if (Result == StateMachineCore::ESetStateResult::Entered)
+		{
+			AppliedRegions |= RegionBit;
+		}
+		else
+		{
+			ReportRejectedRequest(State, Result);
 		}
-		return false;
 	}
 
-	if (CurrentState != nullptr)
+	//Anything requested that is not in the hierarchy never got a turn above.
+	for (uint64 Unassigned = Requests & ~Core.GetAssignedMask(); Unassigned != 0; Unassigned &= Unassigned - 1)
+	{
+		ReportRejectedRequest(static_cast<ECharacterState>(FMath::CountTrailingZeros64(Unassigned)), StateMachineCore::ESetStateResult::Unassigned);
+	}
+}
+
+void UCharacterStateMachine::ReportRejectedRequest(const ECharacterState State, const StateMachineCore::ESetStateResult Reason)
+{
+	TraceRecorder.Record(EStateTraceEvent::RequestRejected, TraceStateIndex(State), static_cast<uint8>(State), static_cast<uint8>(Reason));
+	if (StateRequestRejectedEvent.IsBound()) StateRequestRejectedEvent.Broadcast(State, Reason);
+
+	if (Reason == StateMachineCore::ESetStateResult::Superseded)
 	{
-		if (!TranslatedState->GetTransitionList()[CurrentEnumState]) return false;
-		//If the current state does not allow the change to the new state, return.
+		DebugText([State]() { return TEXT("Request for ") + EnumToString(State) + TEXT(" lost to a higher priority request"); });
+	}
+}
+
+StateMachineCore::ESetStateResult UCharacterStateMachine::ApplyState(const ECharacterState& NewStateEnum)
+{
+	const uint8 FromIndex = TraceStateIndex(NewStateEnum);
+	const uint64 StartCycles = FPlatformTime::Cycles64();
+	const StateMachineCore::ESetStateResult Result = Core.SetState(NewStateEnum, *this, MakeDispatchProbe());
+	TraceRecorder.Record(EStateTraceEvent::Transition, FromIndex, static_cast<uint8>(NewStateEnum), static_cast<uint8>(Result),
+		static_cast<uint32>(FPlatformTime::Cycles64() - StartCycles));
 
-		RunUpdate = false;
-		//Green light! Setting new state is go!
-		CurrentState->OnExitState(*this);
+	if (Result != StateMachineCore::ESetStateResult::Entered)
+	{
+		if (Result == StateMachineCore::ESetStateResult::Unassigned)
+		{
+			DebugText([&NewStateEnum]() { return EnumToString(NewStateEnum) + TEXT(" is not assigned. Cant switch state"); }, 1);
+		}
+		else if (Result == StateMachineCore::ESetStateResult::ConditionFailed)
+		{
+			DebugText([&NewStateEnum]() { return TEXT("Conditions are not met for ") + EnumToString(NewStateEnum); }, 1);
+		}
+		else if (Result == StateMachineCore::ESetStateResult::Blocked)
+		{
+			DebugText([&NewStateEnum]() { return EnumToString(NewStateEnum) + TEXT(" is blocked by its region or another region's state"); }, 1);
+		}
+		return Result;
 	}
-	if (DebugStateMachine && GEngine && NewStateEnum != ECharacterState::DefaultState)
+
+	if (NewStateEnum != ECharacterState::DefaultState)
 	{
-		GEngine->AddOnScreenDebugMessage(-1, 2, FColor::Red, "New State is: " + EnumToString(NewStateEnum));
+		DebugText([&NewStateEnum]() { return TEXT("New State is: ") + EnumToString(NewStateEnum); }, 2);
 	}
 
-	CurrentState = TranslatedState;
-	CurrentEnumState = NewStateEnum;
-	CurrentState->OnEnterState(*this);
-	RunUpdate = true;
-	return true;
+	CurrentState = Core.GetCurrentState();
+	CurrentEnumState = Core.GetCurrentEnumState();
+	//LastUpdateTime is left running. The next update hands the new state all the time since the machine last updated, which a
+	//LOD skipped machine still owes, and a sub-region transition does not cut region 0's delta short.
+	if (Core.GetRegionOf(NewStateEnum) == 0) StateEnterTime = GetDetectionTime();
+	SyncBatchedState();
+	return Result;
 }
 
 void UCharacterStateMachine::UpdateStateMachine()
 {
-	if (CurrentState != nullptr && RunUpdate)
+	if (IsBatched() || !IsDueOnFrame(GFrameCounter)) return;
+	RunStateUpdate();
+}
+
+void UCharacterStateMachine::RunStateUpdate()
+{
+	const double Now = GetWorld()->GetTimeSeconds();
+	const float FrameDeltaTime = static_cast<float>(Now - LastUpdateTime);
+	LastUpdateTime = Now;
+
+	if (UseLODScheduling) EvaluateLOD();
+
+	if (!UseFixedTimestep)
+	{
+		UpdateDeltaTime = FrameDeltaTime;
+		StepStateMachine(FrameDeltaTime, false);
+		OverrideDebug();
+		return;
+	}
+
+	TimeAccumulator += FrameDeltaTime;
+	int32 NumSteps = FMath::FloorToInt32(TimeAccumulator / FixedTimestep);
+	if (NumSteps > MaxSubsteps)
 	{
-		CurrentState->OnUpdateState(*this);
+		NumSteps = MaxSubsteps;
+		TimeAccumulator = MaxSubsteps * static_cast<double>(FixedTimestep);
 	}
+
+	UpdateDeltaTime = FixedTimestep;
+	RunSteps(NumSteps, FixedTimestep);
+	TimeAccumulator -= NumSteps * static_cast<double>(FixedTimestep);
+	InterpolationAlpha = static_cast<float>(TimeAccumulator / FixedTimestep);
 	OverrideDebug();
 }
 
+void UCharacterStateMachine::StepStateMachine(const float DeltaTime, const bool Detect)
+{
+	SimulationTime += DeltaTime;
+	Core.Step(*this, DeltaTime, MakeDispatchProbe());
+
+	if (!Detect) return;
+	if (!IsCurrentStateNull())
+	{
+		PrepareDetection();
+		DetectInPriorityOrder(false, EvaluatePredicates());
+	}
+	CommitTransitions();
+}
+
+void UCharacterStateMachine::RunSteps(const int32 NumSteps, const float DeltaTime)
+{
+	if (NumSteps <= 0) return;
+
+	//Async traces are per engine frame, not per step. Every step reads the results of last frame's submission and only the traces
+	//queued by the last step go out.
+	ResolveMechanicTraces();
+	for (int32 Step = 0; Step < NumSteps; ++Step)
+	{
+		StepStateMachine(DeltaTime, true);
+	}
+	SubmitMechanicTraces();
+}
+
+void UCharacterStateMachine::SimulateSteps(const int32 NumSteps, const float DeltaTime)
+{
+	UpdateDeltaTime = DeltaTime;
+	RunSteps(NumSteps, DeltaTime);
+}
+
+void UCharacterStateMachine::SetUseFixedTimestep(const bool Enable)
+{
+	if (UseFixedTimestep == Enable) return;
+	UseFixedTimestep = Enable;
+
+	//The subsystem keeps its own copy of the flag, registering again refreshes it.
+	if (IsBatched())
+	{
+		UCharacterStateMachineSubsystem* Subsystem = BatchSubsystem;
+		Subsystem->UnregisterMachine(*this);
+		Subsystem->RegisterMachine(*this);
+	}
+}
+
 void UCharacterStateMachine::SetupStateMachine()
+{
+	SCOPE_CYCLE_COUNTER(STAT_SetupStateMachine);
+
+	const ACharacter* Character = Cast<ACharacter>(GetOwner());
+	OwnerMovement = Character != nullptr ? Character->GetCharacterMovement() : GetOwner()->FindComponentByClass<UCharacterMovementComponent>();
+	CurrentState = nullptr;
+	CurrentEnumState = ECharacterState::DefaultState;
+
+	if (Config != nullptr ? !SetupFromConfig() : !SetupFromHierarchy()) return;
+
+	BuildSnapshotLayout();
+	RefreshDebugMechanics();
+
+	PredicateStateMask = 0;
+	for (const auto& Mechanic : MechanicsList)
+	{
+		if (Mechanic.Component->GetSettings().UsesPredicate()) PredicateStateMask |= StateMachineCore::StateBit(Mechanic.State);
+	}
+
+	SyncBatchedState();
+	if (IsBatched()) BatchSubsystem->SyncPredicates(*this);
+}
+
+bool UCharacterStateMachine::SetupFromConfig()
+{
+	//The config was validated and compiled when it was saved, all that is left is copying it out and finding the components.
+	FStateMachineCompiledConfig Compiled;
+	if (!Config->LoadCompiled(Compiled))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("State machine config %s has no compiled data for this version. Save it again."), *Config->GetName());
+		return false;
+	}
+
+	SetSharedDefinition(Compiled.Definition);
+	const FCharacterStateMachineDefinition& Definition = Core.GetDefinition();
+
+	AActor* Owner = GetOwner();
+	const FStateMechanicArchetype& Archetype = FindOrAddArchetype(*Owner->GetClass());
+	MechanicsList.Reset(Definition.NumBound);
+	for (int32 Index = 0; Index < Definition.NumBound; ++Index)
+	{
+		const ECharacterState State = Definition.PriorityOrder[Index];
+		//The config compiled each mechanic from the component named after its state, the same name is looked up here.
+		UStateComponentBase* Component = FindMechanic(*Owner, Archetype, State, true);
+		if (Component == nullptr)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("%s has no mechanic for state %s of config %s."), *Owner->GetName(), *EnumToString(State), *Config->GetName());
+			continue;
+		}
+
+		MechanicsList.Add(FMechanicStateData(State, Component));
+		Core.BindState(State, Component);
+	}
+	return true;
+}
+
+bool UCharacterStateMachine::SetupFromHierarchy()
 {
 	if (MechanicsHierarchy.IsEmpty())
 	{
-		if (DebugStateMachine && GEngine)
+		DebugText([]() { return FString(TEXT("State machine is not properly setup. No mechanics found.")); });
+		return false;
+	}
+
+	//Duplicates are reported by IsDataValid when the owner is saved. Here BuildDefinition keeps the first of them.
+	int32 NumMechanics = MechanicsHierarchy.Num();
+	for (const FStateMachineRegion& Region : Regions) NumMechanics += Region.MechanicsHierarchy.Num();
+	MechanicsList.Reset(NumMechanics);
+
+	AActor* Owner = GetOwner();
+	const FStateMechanicArchetype& Archetype = FindOrAddArchetype(*Owner->GetClass());
+
+	FCharacterStateMachineDefinition Definition;
+	BuildDefinition(Definition, MechanicsHierarchy, Regions, [this, Owner, &Archetype](const ECharacterState State) -> const FStateMechanicSettings*
+	{
+		UStateComponentBase* Component = FindMechanic(*Owner, Archetype, State, true);
+		if (Component == nullptr)
 		{
-			GEngine->AddOnScreenDebugMessage(-1, 0, FColor::Red, "State machine is not properly setup. No mechanics found.");
+			// Handle the case where the component reference cannot be obtained
+			UE_LOG(LogTemp, Warning, TEXT("Failed to get component reference for state %s. Game is prone to crash."), *EnumToString(State));
+			return nullptr;
 		}
-		return;
+
+		MechanicsList.Add(FMechanicStateData(State, Component));
+		return &Component->GetSettings();
+	});
+
+	//Only the state pointers are this machine's own, everything else is shared with the machines set up the same way.
+	SetSharedDefinition(Definition);
+	for (const auto& Mechanic : MechanicsList)
+	{
+		Core.BindState(Mechanic.State, Mechanic.Component);
+	}
+	return true;
+}
+
+void UCharacterStateMachine::ResetForReuse()
+{
+	SCOPE_CYCLE_COUNTER(STAT_ResetStateMachineForReuse);
+
+	Core.ClearCurrentStates();
+	CurrentState = nullptr;
+	CurrentEnumState = ECharacterState::DefaultState;
+	PendingRequestMask = 0;
+	DirtyDetectorMask = 0;
+	LastMovementInput = FVector2d::ZeroVector;
+	UpdateDeltaTime = 0;
+	LastUpdateTime = GetWorld()->GetTimeSeconds();
+	TimeAccumulator = 0;
+	SimulationTime = 0;
+	InterpolationAlpha = 1;
+	StateEnterTime = LastGroundedTime = GetDetectionTime();
+	CustomPredicateInputs[0] = CustomPredicateInputs[1] = 0;
+
+	for (const auto& Mechanic : MechanicsList)
+	{
+		Mechanic.Component->ResetDetectionState();
+	}
+	SyncBatchedState();
+}
+
+void UCharacterStateMachine::SaveSnapshot(uint8* Buffer) const
+{
+	//Zeroed first, so the padding between fields is the same in every snapshot and does not show up in the deltas.
+	FStateMachineSnapshotHeader Header;
+	FMemory::Memzero(Header);
+	Header.LastUpdateTime = LastUpdateTime;
+	Header.TimeAccumulator = TimeAccumulator;
+	Header.SimulationTime = SimulationTime;
+	Header.StateEnterTime = StateEnterTime;
+	Header.LastGroundedTime = LastGroundedTime;
+	Header.LastMovementInput = LastMovementInput;
+	Header.PendingRequestMask = PendingRequestMask;
+	Header.InputSerial = InputSerial;
+	Header.UpdateDeltaTime = UpdateDeltaTime;
+	FMemory::Memcpy(Header.CustomPredicateInputs, CustomPredicateInputs, sizeof(CustomPredicateInputs));
+	Header.RunUpdateMask = Core.SaveCurrentStates(Header.CurrentStates);
+	Header.UpdateInterval = UpdateInterval;
+	FMemory::Memcpy(Buffer, &Header, sizeof(Header));
+
+	uint8* MechanicData = Buffer + sizeof(Header);
+	for (int32 Index = 0; Index < MechanicsList.Num(); ++Index)
+	{
+		if (MechanicSnapshotOffsets[Index] != INDEX_NONE) MechanicsList[Index].Component->SaveSnapshot(MechanicData + MechanicSnapshotOffsets[Index]);
+	}
+}
+
+void UCharacterStateMachine::RestoreSnapshot(const uint8* Buffer)
+{
+	FStateMachineSnapshotHeader Header;
+	FMemory::Memcpy(&Header, Buffer, sizeof(Header));
+
+	const bool HadRequests = PendingRequestMask != 0;
+	LastUpdateTime = Header.LastUpdateTime;
+	TimeAccumulator = Header.TimeAccumulator;
+	SimulationTime = Header.SimulationTime;
+	StateEnterTime = Header.StateEnterTime;
+	LastGroundedTime = Header.LastGroundedTime;
+	LastMovementInput = Header.LastMovementInput;
+	PendingRequestMask = Header.PendingRequestMask;
+	InputSerial = Header.InputSerial;
+	UpdateDeltaTime = Header.UpdateDeltaTime;
+	FMemory::Memcpy(CustomPredicateInputs, Header.CustomPredicateInputs, sizeof(CustomPredicateInputs));
+	UpdateInterval = Header.UpdateInterval;
+	Core.RestoreCurrentStates(Header.CurrentStates, Header.RunUpdateMask);
+	CurrentState = Core.GetCurrentState();
+	CurrentEnumState = Core.GetCurrentEnumState();
+	DirtyDetectorMask = 0;
+
+	const uint8* MechanicData = Buffer + sizeof(Header);
+	for (int32 Index = 0; Index < MechanicsList.Num(); ++Index)
+	{
+		UStateComponentBase* Component = MechanicsList[Index].Component;
+		Component->ResetDetectionState();
+		if (MechanicSnapshotOffsets[Index] != INDEX_NONE) Component->RestoreSnapshot(MechanicData + MechanicSnapshotOffsets[Index]);
 	}
-	CheckForDuplicates(); //This will stop the game if there is a duplicate.
-	GetComponentReferences(MechanicsHierarchy);
+
+	if (PendingRequestMask != 0 && !HadRequests && IsBatched())
+	{
+		BatchSubsystem->MarkPendingCommit(*this);
+	}
+	SyncBatchedState();
+}
+
+void UCharacterStateMachine::GetResourceSizeEx(FResourceSizeEx& CumulativeResourceSize)
+{
+	Super::GetResourceSizeEx(CumulativeResourceSize);
+
+	SIZE_T RegionBytes = Regions.GetAllocatedSize();
+	for (const FStateMachineRegion& Region : Regions) RegionBytes += Region.MechanicsHierarchy.GetAllocatedSize();
+
+	CumulativeResourceSize.AddDedicatedSystemMemoryBytes(MechanicsHierarchy.GetAllocatedSize() + RegionBytes + LODLevels.GetAllocatedSize()
+		+ MechanicsList.GetAllocatedSize() + DebuggedMechanics.GetAllocatedSize() + MechanicSnapshotOffsets.GetAllocatedSize()
+		+ TraceRecorder.GetAllocatedSize());
 }
 
 void UCharacterStateMachine::OverrideDebug() const
 {
-	if (MechanicsList.IsEmpty()) return;
-	
-	for (const auto& Mechanic : MechanicsList )
+	for (UStateComponentBase* Mechanic : DebuggedMechanics)
 	{
-		if (Mechanic.Component->GetDebugMechanic()) Mechanic.Component->OverrideDebug();
+		Mechanic->OverrideDebug();
+	}
+}
+
+void UCharacterStateMachine::RefreshDebugMechanics()
+{
+	DebuggedMechanics.Reset();
+	for (const auto& Mechanic : MechanicsList)
+	{
+		if (Mechanic.Component->GetDebugMechanic()) DebuggedMechanics.Add(Mechanic.Component);
 	}
 }
 
 #pragma region Override Functions For Player Code
 
-void UCharacterStateMachine::OverrideMovementInput(FVector2d& NewMovementVector)
+void UCharacterStateMachine::ApplyOverrides(FStateInputOverrides& Inputs)
 {
-	if (CurrentState != nullptr)
+	if (EnumHasAnyFlags(Inputs.Channels, EStateInputChannel::Movement))
 	{
-		CurrentState->OverrideMovementInput(*this, NewMovementVector);
+		TrackMovementInput(Inputs.MovementVector);
 	}
+
+	//Every region's current state gets a go, in region order, so an upper body action can adjust what locomotion produced.
+	ForEachCurrentState([this, &Inputs](UStateComponentBase& State)
+	{
+		//Channels the state does not touch are skipped, and if that is all of them, so is the call.
+		const EStateInputChannel Channels = Inputs.Channels & State.GetOverriddenInputChannels();
+		if (Channels != EStateInputChannel::None)
+		{
+#if DO_ENSURE
+			const FStateInputOverrides Before = Inputs;
+			State.ApplyOverrides(*this, Inputs, Channels);
+			ensureMsgf(!EnumHasAnyFlags(Inputs.GetChangedChannels(Before), ~Channels), TEXT("%s changed input channels it was not handed, check its OverriddenInputChannels"),
+				*State.GetName());
+#else
+			State.ApplyOverrides(*this, Inputs, Channels);
+#endif
+		}
+	});
+}
+
+void UCharacterStateMachine::OverrideMovementInput(FVector2d& NewMovementVector)
+{
+	TrackMovementInput(NewMovementVector);
+
+	ForEachCurrentState([this, &NewMovementVector](UStateComponentBase& State)
+	{
+		if (EnumHasAnyFlags(State.GetOverriddenInputChannels(), EStateInputChannel::Movement)) State.OverrideMovementInput(*this, NewMovementVector);
+	});
 }
 
 void UCharacterStateMachine::OverrideAcceleration(float& NewSpeed)
 {
-	if (CurrentState != nullptr)
+	ForEachCurrentState([this, &NewSpeed](UStateComponentBase& State)
 	{
-		CurrentState->OverrideAcceleration(*this, NewSpeed);
-	}
+		if (EnumHasAnyFlags(State.GetOverriddenInputChannels(), EStateInputChannel::Acceleration)) State.OverrideAcceleration(*this, NewSpeed);
+	});
 }
 
 void UCharacterStateMachine::OverrideCameraInput(FVector2d& NewRotationVector)
 {
-	if (CurrentState != nullptr)
+	ForEachCurrentState([this, &NewRotationVector](UStateComponentBase& State)
+	{
+		if (EnumHasAnyFlags(State.GetOverriddenInputChannels(), EStateInputChannel::Camera)) State.OverrideCameraInput(*this, NewRotationVector);
+	});
+}
+
+void UCharacterStateMachine::TrackMovementInput(const FVector2d& NewMovementVector)
+{
+	if (NewMovementVector != LastMovementInput)
 	{
-		CurrentState->OverrideCameraInput(*this, NewRotationVector);
+		LastMovementInput = NewMovementVector;
+		InputSerial++;
 	}
 }
 
@@ -135,19 +586,211 @@ void UCharacterStateMachine::OverrideCameraInput(FVector2d& NewRotationVector)
 
 void UCharacterStateMachine::DetectStates()
 {
-	if (CurrentState == nullptr && DebugStateMachine)
+	if (IsBatched()) return;
+	if (TraceSubmitFrame + 1 == GFrameCounter) ResolveMechanicTraces();
+	//Fixed timestep machines detect after every step in UpdateStateMachine.
+	if (!UseFixedTimestep && IsDueOnFrame(GFrameCounter)) RunDetection();
+
+	//Commit point for requested transitions, whether they came from detection, input or gameplay code.
+	CommitTransitions();
+}
+
+void UCharacterStateMachine::RunDetection()
+{
+	if (IsCurrentStateNull())
 	{
-		DebugText("No current mechanical state. Automatic detection is off");
+		DebugText([]() { return FString(TEXT("No current mechanical state. Automatic detection is off")); });
 		return;
 	}
-	
-	for (const auto Mechanic : MechanicsList)
+
+	PrepareDetection();
+	DetectInPriorityOrder(false, EvaluatePredicates());
+	SubmitMechanicTraces();
+}
+
+void UCharacterStateMachine::DetectInPriorityOrder(const bool UseQueriedCandidates, const uint64 CandidateMask)
+{
+	//The core walks mechanics in MechanicsHierarchy order. Mechanics that are statically disallowed from the current state, or
+	//have nothing new to look at, are filtered out before any virtual call. The first one that switches its region's state wins.
+	//With DeferTransitions on, a detector requesting a state counts as a switch too, anything after it has lower priority.
+	Detecting = true;
+	const bool TraceDetector = TraceDetectors && TraceRecorder.IsRecording();
+	Core.Detect(DirtyDetectorMask, [this, UseQueriedCandidates, CandidateMask, TraceDetector](const ECharacterState State, UStateComponentBase& Component)
+	{
+		DetectorRequested = false;
+		const uint8 FromIndex = TraceDetector ? TraceStateIndex(State) : 0;
+		const uint64 StartCycles = TraceDetector ? FPlatformTime::Cycles64() : 0;
+
+		Profiler(State, StateMachineCore::EStateDispatch::Detect, [&]()
+		{
+			if (Component.GetSettings().UsesPredicate())
+			{
+				if ((CandidateMask & StateMachineCore::StateBit(State)) != 0) SetState(State);
+			}
+			else if (!Component.SupportsParallelDetection())
+			{
+				Component.OverrideDetectState(*this);
+			}
+			else if (UseQueriedCandidates ? (CandidateMask & StateMachineCore::StateBit(State)) != 0 : Component.QueryDetectState(*this))
+			{
+				SetState(State);
+			}
+		});
+
+		if (TraceDetector)
+		{
+			TraceRecorder.Record(EStateTraceEvent::Detector, FromIndex, static_cast<uint8>(State), 0, static_cast<uint32>(FPlatformTime::Cycles64() - StartCycles));
+		}
+		return DetectorRequested;
+	});
+	Detecting = false;
+
+	DebugText([this]()
 	{
-		if (CurrentState == Mechanic.Component || !CurrentState->GetTransitionList()[CurrentEnumState])
+		const FStateDetectionStats& DetectionStats = Core.GetDetectionStats();
+		return FString::Printf(TEXT("Detection: %d evaluated, %d disallowed, %d unchanged, %d skipped after transition"),
+			DetectionStats.Evaluated, DetectionStats.SkippedDisallowed, DetectionStats.SkippedUnchanged, DetectionStats.SkippedAfterTransition);
+	});
+}
+
+uint64 UCharacterStateMachine::QueryDetectStates(const uint64 DetectableMask) const
+{
+	uint64 Candidates = 0;
+
+	for (const auto& Mechanic : MechanicsList)
+	{
+		const uint64 StateBit = StateMachineCore::StateBit(Mechanic.State);
+		if ((DetectableMask & DirtyDetectorMask & StateBit & ~PredicateStateMask) == 0 || !Mechanic.Component->SupportsParallelDetection())
 		{
 			continue;
 		}
-		Mechanic.Component->OverrideDetectState(*this);
+
+		if (Mechanic.Component->QueryDetectState(*this))
+		{
+			Candidates |= StateBit;
+		}
+	}
+	return Candidates;
+}
+
+void UCharacterStateMachine::CommitDetectedStates(const uint64 CandidateMask, const bool Queried)
+{
+	if (IsCurrentStateNull()) return;
+
+	//Serial-only mechanics are detected here too, in the same priority order as the queried candidates.
+	//Once something commits, the remaining candidates are stale anyway, as they were queried against the state we just left.
+	DetectInPriorityOrder(Queried, CandidateMask);
+	SubmitMechanicTraces();
+}
+
+void UCharacterStateMachine::PrepareDetection()
+{
+	ResolveMechanicTraces();
+	DirtyDetectorMask = GatherDirtyDetectors();
+}
+
+uint64 UCharacterStateMachine::GatherDirtyDetectors()
+{
+	FStateDetectionContext Context;
+	Context.Time = GetDetectionTime();
+	Context.InputSerial = InputSerial;
+	Context.ActiveStates = Core.GetActiveMask();
+	if (OwnerMovement != nullptr)
+	{
+		Context.Velocity = OwnerMovement->Velocity;
+		Context.Grounded = OwnerMovement->IsMovingOnGround();
+	}
+	if (Context.Grounded) LastGroundedTime = Context.Time;
+
+	uint64 DirtyMask = 0;
+	for (const auto& Mechanic : MechanicsList)
+	{
+		if (Mechanic.Component->ConsumeDetectionDirty(Context))
+		{
+			DirtyMask |= StateMachineCore::StateBit(Mechanic.State);
+		}
+	}
+	return DirtyMask;
+}
+
+double UCharacterStateMachine::GetDetectionTime() const
+{
+	return UseFixedTimestep ? SimulationTime : GetWorld()->GetTimeSeconds();
+}
+
+void UCharacterStateMachine::SetCustomPredicateInput(const EStatePredicateInput Input, const float Value)
+{
+	if (Input == EStatePredicateInput::Custom0 || Input == EStatePredicateInput::Custom1)
+	{
+		CustomPredicateInputs[static_cast<uint8>(Input) - static_cast<uint8>(EStatePredicateInput::Custom0)] = Value;
+	}
+}
+
+float UCharacterStateMachine::GetCustomPredicateInput(const EStatePredicateInput Input) const
+{
+	if (Input != EStatePredicateInput::Custom0 && Input != EStatePredicateInput::Custom1) return 0;
+	return CustomPredicateInputs[static_cast<uint8>(Input) - static_cast<uint8>(EStatePredicateInput::Custom0)];
+}
+
+void UCharacterStateMachine::GatherPredicateInputs(float* const* Columns, const int32 Index) const
+{
+	const double Now = GetDetectionTime();
+	const FVector Velocity = OwnerMovement != nullptr ? OwnerMovement->Velocity : FVector::ZeroVector;
+	const bool Grounded = OwnerMovement != nullptr && OwnerMovement->IsMovingOnGround();
+
+	Columns[static_cast<uint8>(EStatePredicateInput::HorizontalSpeed)][Index] = static_cast<float>(Velocity.Size2D());
+	Columns[static_cast<uint8>(EStatePredicateInput::VerticalSpeed)][Index] = static_cast<float>(Velocity.Z);
+	Columns[static_cast<uint8>(EStatePredicateInput::Grounded)][Index] = Grounded ? 1 : 0;
+	//LastGroundedTime is only as fresh as the last detection, so it is not trusted while grounded.
+	Columns[static_cast<uint8>(EStatePredicateInput::AirTime)][Index] = Grounded ? 0 : static_cast<float>(Now - LastGroundedTime);
+	Columns[static_cast<uint8>(EStatePredicateInput::MovementInput)][Index] = static_cast<float>(LastMovementInput.Size());
+	Columns[static_cast<uint8>(EStatePredicateInput::TimeInState)][Index] = static_cast<float>(Now - StateEnterTime);
+	Columns[static_cast<uint8>(EStatePredicateInput::Custom0)][Index] = CustomPredicateInputs[0];
+	Columns[static_cast<uint8>(EStatePredicateInput::Custom1)][Index] = CustomPredicateInputs[1];
+}
+
+uint64 UCharacterStateMachine::EvaluatePredicates() const
+{
+	if (PredicateStateMask == 0) return 0;
+
+	//One machine, so every column is a single value.
+	float Inputs[NumPredicateInputs];
+	float* Columns[NumPredicateInputs];
+	for (int32 Input = 0; Input < NumPredicateInputs; ++Input) Columns[Input] = &Inputs[Input];
+	GatherPredicateInputs(Columns, 0);
+
+	uint64 Candidates = 0;
+	for (const auto& Mechanic : MechanicsList)
+	{
+		const FStateMechanicSettings& Settings = Mechanic.Component->GetSettings();
+		if (Settings.UsesPredicate() && Settings.EvaluatePredicate(Inputs))
+		{
+			Candidates |= StateMachineCore::StateBit(Mechanic.State);
+		}
+	}
+	return Candidates;
+}
+
+void UCharacterStateMachine::ResolveMechanicTraces()
+{
+	for (const auto& Mechanic : MechanicsList)
+	{
+		Mechanic.Component->ResolveQueuedTraces();
+	}
+}
+
+void UCharacterStateMachine::SubmitMechanicTraces()
+{
+	bool Submitted = false;
+	for (const auto& Mechanic : MechanicsList)
+	{
+		Submitted |= Mechanic.Component->SubmitQueuedTraces();
+	}
+
+	if (Submitted && TraceSubmitFrame != GFrameCounter)
+	{
+		TraceSubmitFrame = GFrameCounter;
+		if (IsBatched()) BatchSubsystem->MarkPendingTraceResolve(*this);
 	}
 }
 
@@ -156,7 +799,7 @@ void UCharacterStateMachine::DetectStates()
 #pragma region Player Helper Methods
 void UCharacterStateMachine::ManualExitState()
 {
-	if (CurrentState != nullptr)
+	if (!IsCurrentStateNull())
 	{
 		SetState(ECharacterState::DefaultState);
 	}
@@ -166,82 +809,280 @@ void UCharacterStateMachine::ManualExitState()
 
 #pragma region State Machine Helper Methods
 
-FString UCharacterStateMachine::EnumToString(const ECharacterState& ToConvert)
+const FString& UCharacterStateMachine::EnumToString(const ECharacterState& ToConvert)
 {
-	FString EnumAsString = UEnum::GetValueAsString(ToConvert);
+	//GetNameStringByIndex already drops the "ECharacterState::" prefix.
+	struct FStateNameTable
+	{
+		FString Names[NumCharacterStates];
+
+		FStateNameTable()
+		{
+			const UEnum* Enum = StaticEnum<ECharacterState>();
+			for (int32 Index = 0; Index < NumCharacterStates; ++Index)
+			{
+				Names[Index] = Enum->GetNameStringByIndex(Index);
+			}
+		}
+	};
+
+	static const FStateNameTable Table;
+	return Table.Names[static_cast<uint8>(ToConvert)];
+}
 
-	// Split the string using "::" as a delimiter and take the second part
-	TArray<FString> Parts;
-	EnumAsString.ParseIntoArray(Parts, TEXT("::"), true);
+const FStateMechanicArchetype& UCharacterStateMachine::FindOrAddArchetype(const UClass& OwnerClass)
+{
+	if (const FStateMechanicArchetype* Archetype = MechanicArchetypes.Find(&OwnerClass)) return *Archetype;
 
-	if (Parts.Num() > 1)
+	FStateMechanicArchetype& Archetype = MechanicArchetypes.Add(&OwnerClass);
+	for (int32 Index = 0; Index < NumCharacterStates; ++Index)
 	{
-		return Parts[1];
+		//Mechanics are named after their state, the same name the component reference lookup below uses.
+		Archetype.Properties[Index] = FindFProperty<FObjectPropertyBase>(&OwnerClass, FName(*EnumToString(static_cast<ECharacterState>(Index))));
 	}
+	return Archetype;
+}
 
-	// Return the original string if splitting fails
-	return EnumAsString;
+void UCharacterStateMachine::SetSharedDefinition(const FCharacterStateMachineDefinition& Definition)
+{
+	//Acquired before the old one is released, so setting up again the same way does not free and add it again.
+	const FCharacterStateMachineDefinition* Previous = SharedDefinition;
+	SharedDefinition = &SharedDefinitions.Acquire(Definition);
+	Core.SetDefinition(*SharedDefinition);
+	SharedDefinitions.Release(Previous);
 }
 
-void UCharacterStateMachine::GetComponentReferences(const TArray<ECharacterState>& HierarchyArray)
+void UCharacterStateMachine::ReleaseSharedDefinition()
 {
-	for (const ECharacterState& State : HierarchyArray)
+	Core.Reset();
+	CurrentState = nullptr;
+	SharedDefinitions.Release(SharedDefinition);
+	SharedDefinition = nullptr;
+}
+
+UStateComponentBase* UCharacterStateMachine::FindMechanic(AActor& Owner, const FStateMechanicArchetype& Archetype, const ECharacterState State,
+	const bool AllowNameLookup)
+{
+	const FObjectPropertyBase* Property = Archetype.Properties[static_cast<uint8>(State)];
+	UStateComponentBase* Component = Property != nullptr ? Cast<UStateComponentBase>(Property->GetObjectPropertyValue_InContainer(&Owner)) : nullptr;
+
+	//Mechanics without a property on the owner class, added at runtime for example, are still found by name.
+	if (Component == nullptr && AllowNameLookup)
 	{
 		FComponentReference NewRef;
 		NewRef.PathToComponent = EnumToString(State);
-		if (UStateComponentBase* Component = Cast<UStateComponentBase>(NewRef.GetComponent(GetOwner())); Component != nullptr)
+		Component = Cast<UStateComponentBase>(NewRef.GetComponent(&Owner));
+	}
+	return Component;
+}
+
+void UCharacterStateMachine::BuildDefinition(FCharacterStateMachineDefinition& Definition, const TArray<ECharacterState>& Hierarchy,
+	const TArray<FStateMachineRegion>& InRegions, const TFunctionRef<const FStateMechanicSettings*(ECharacterState)> FindSettings)
+{
+	auto AddMechanics = [&Definition, &FindSettings](const TArray<ECharacterState>& States, const int32 Region)
+	{
+		for (const ECharacterState State : States)
 		{
-			MechanicsList.Add(FMechanicStateData(State, Component));
+			if ((Definition.AssignedMask & StateMachineCore::StateBit(State)) != 0) continue;
+
+			const FStateMechanicSettings* Settings = FindSettings(State);
+			if (Settings == nullptr) continue;
+
+			Definition.BindState(State, Region);
+			for (uint64 FromMask = Settings->TransitionFromMask; FromMask != 0; FromMask &= FromMask - 1)
+			{
+				Definition.Table.Allow(static_cast<ECharacterState>(FMath::CountTrailingZeros64(FromMask)), State);
+			}
+			Definition.SetGuards(State, Settings->RequiredActiveMask, Settings->BlockedByActiveMask);
 		}
-		else
+	};
+
+	AddMechanics(Hierarchy, 0);
+	for (const FStateMachineRegion& Region : InRegions)
+	{
+		const int32 RegionIndex = Region.NestedInState ? Definition.AddRegion(Region.ParentState) : Definition.AddRegion();
+		if (RegionIndex == INDEX_NONE)
 		{
-			// Handle the case where the component reference cannot be obtained
-			UE_LOG(LogTemp, Warning, TEXT("Failed to get component reference for state %s. Game is prone to crash."), *EnumToString(State));
+			UE_LOG(LogTemp, Warning, TEXT("Failed to set up region %s. Its parent state is not assigned yet, or there are too many regions."), *Region.Name.ToString());
+			continue;
 		}
+		AddMechanics(Region.MechanicsHierarchy, RegionIndex);
 	}
 }
 
-void UCharacterStateMachine::CheckForDuplicates()
+bool UCharacterStateMachine::ValidateHierarchy(const TArray<ECharacterState>& Hierarchy, const TArray<FStateMachineRegion>& InRegions,
+	TArray<FText>& OutErrors)
 {
-	TSet<ECharacterState> UniqueStates;
+	const int32 NumErrorsBefore = OutErrors.Num();
+	if (Hierarchy.IsEmpty())
+	{
+		OutErrors.Add(FText::FromString(TEXT("Mechanics Hierarchy is empty.")));
+	}
+	if (InRegions.Num() >= FCharacterStateMachineCore::MaxNumRegions)
+	{
+		OutErrors.Add(FText::FromString(FString::Printf(TEXT("%d regions, at most %d fit next to Mechanics Hierarchy."),
+			InRegions.Num(), FCharacterStateMachineCore::MaxNumRegions - 1)));
+	}
 
-	for (const ECharacterState& State : MechanicsHierarchy)
+	//A state can only be in one region, and a nested region's parent has to be in a hierarchy listed before it.
+	uint64 SeenMask = 0;
+	auto CheckStates = [&SeenMask, &OutErrors](const TArray<ECharacterState>& States)
 	{
-		if (UniqueStates.Contains(State))
+		for (const ECharacterState State : States)
 		{
-			// Duplicate found, display an error message
-			const FString ErrorMessage = FString::Printf(TEXT("Duplicate ERROR: %s. Edit State Machine"), *EnumToString(State));
-			GEngine->AddOnScreenDebugMessage(-1, 20, FColor::Red, ErrorMessage);
+			if (State >= ECharacterState::Count)
+			{
+				OutErrors.Add(FText::FromString(FString::Printf(TEXT("Invalid state %d."), static_cast<int32>(State))));
+				continue;
+			}
+			if ((SeenMask & StateMachineCore::StateBit(State)) != 0)
+			{
+				OutErrors.Add(FText::FromString(FString::Printf(TEXT("Duplicate ERROR: %s. Edit State Machine"), *EnumToString(State))));
+			}
+			SeenMask |= StateMachineCore::StateBit(State);
+		}
+	};
 
-			// Pause the game
-			UGameplayStatics::SetGamePaused(GetWorld(), true);
-			return;
+	CheckStates(Hierarchy);
+	for (const FStateMachineRegion& Region : InRegions)
+	{
+		if (Region.NestedInState && (SeenMask & StateMachineCore::StateBit(Region.ParentState)) == 0)
+		{
+			OutErrors.Add(FText::FromString(FString::Printf(TEXT("Region %s is nested in %s, which is not in a hierarchy before it."),
+				*Region.Name.ToString(), *EnumToString(Region.ParentState))));
 		}
-		UniqueStates.Add(State);
+		CheckStates(Region.MechanicsHierarchy);
 	}
+	return OutErrors.Num() == NumErrorsBefore;
 }
 
-UStateComponentBase* UCharacterStateMachine::TranslateEnumToState(const ECharacterState& Enum) const
+void UCharacterStateMachine::BuildSnapshotLayout()
 {
-	// Iterate through the MechanicsHierarchy and find the matching state
-	for (const auto HierarchyItem : MechanicsList)
+	MechanicSnapshotSize = 0;
+	MechanicSnapshotOffsets.Reset(MechanicsList.Num());
+
+	for (const auto& Mechanic : MechanicsList)
 	{
-		if (HierarchyItem.State == Enum)
-		{
-			// Return the UStateComponentBase associated with the matching state
-			return HierarchyItem.Component;
-		}
+		const int32 Size = Mechanic.Component->GetSnapshotSize();
+		MechanicSnapshotOffsets.Add(Size > 0 ? MechanicSnapshotSize : INDEX_NONE);
+		MechanicSnapshotSize += FMath::Max(Size, 0);
+	}
+}
+
+#if WITH_EDITOR
+EDataValidationResult UCharacterStateMachine::IsDataValid(FDataValidationContext& Context) const
+{
+	EDataValidationResult Result = Super::IsDataValid(Context);
+
+	//With a config, the hierarchy here is not used and the config validates its own.
+	TArray<FText> Errors;
+	if (Config == nullptr && !ValidateHierarchy(MechanicsHierarchy, Regions, Errors))
+	{
+		for (const FText& Error : Errors) Context.AddError(Error);
+		Result = EDataValidationResult::Invalid;
 	}
+	return Result;
+}
+#endif
 
-	// If no matching state is found, return nullptr or handle accordingly
-	return nullptr;
+void UCharacterStateMachine::SyncBatchedState() const
+{
+	if (!IsBatched()) return;
+	BatchSubsystem->SyncMachine(BatchIndex, GetCurrentEnumState(), Core.ShouldRunUpdate(), GetDetectableMask(), UpdateInterval, LODPhase);
 }
 
-void UCharacterStateMachine::DebugText(const FString& Text)
+void UCharacterStateMachine::EvaluateLOD()
 {
-	if (GEngine)
+	const APlayerCameraManager* CameraManager = UGameplayStatics::GetPlayerCameraManager(this, 0);
+	if (CameraManager == nullptr) return;
+
+	const double DistanceSquared = FVector::DistSquared(CameraManager->GetCameraLocation(), GetOwner()->GetActorLocation());
+	int32 NewInterval = 1;
+	for (const FStateMachineLODLevel& Level : LODLevels)
 	{
-		GEngine->AddOnScreenDebugMessage(-1,0, FColor::Red, Text);
+		if (DistanceSquared < FMath::Square(static_cast<double>(Level.MinDistance))) break;
+		NewInterval = Level.FrameInterval;
 	}
+
+	NewInterval = FMath::Clamp(NewInterval, 1, 255);
+	if (NewInterval != UpdateInterval)
+	{
+		UpdateInterval = static_cast<uint8>(NewInterval);
+		SyncBatchedState();
+	}
+}
+
+uint8 UCharacterStateMachine::TraceStateIndex(const ECharacterState State) const
+{
+	const int32 Region = Core.GetRegionOf(State);
+	return Core.GetCurrentState(Region) == nullptr ? FStateMachineTraceRecorder::NoState : static_cast<uint8>(Core.GetCurrentEnumState(Region));
+}
+
+bool UCharacterStateMachine::DumpTransitionTrace(const FString& FilePath)
+{
+	const FString OwnerName = GetOwner() != nullptr ? GetOwner()->GetName() : GetName();
+	const FString Path = !FilePath.IsEmpty()
+		? FilePath
+		: FPaths::ProjectSavedDir() / TEXT("StateMachineTraces") / FString::Printf(TEXT("%s_%s.smtrace"), *OwnerName, *FDateTime::Now().ToString());
+
+	return TraceRecorder.DumpToFile(Path, OwnerName);
 }
+
 #pragma endregion
+
+static FAutoConsoleCommandWithWorldAndArgs StateMachineMemoryReportCommand(
+	TEXT("StateMachine.MemoryReport"),
+	TEXT("Logs the measured bytes per character of every state machine in the world and its mechanics, and an estimate of what they would ")
+	TEXT("take without shared definitions and mechanic settings. Optional argument: the number of characters to project to, 1000 by default."),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		const int32 NumCharacters = Args.IsEmpty() ? 1000 : FMath::Max(FCString::Atoi(*Args[0]), 1);
+
+		//Own is what every character pays for itself now, measured on the live objects. The unshared layout no longer exists, so
+		//it is estimated by adding back what sharing took off every character: the size of a definition per machine, of the
+		//settings per mechanic, and the editable settings containers that mechanics with a Definition free, measured on the
+		//template they were copied from.
+		int64 OwnBytes = 0;
+		int64 FreedContainerBytes = 0;
+		int64 CopiedBytes = 0;
+		int32 NumMachines = 0;
+		int32 NumMechanics = 0;
+
+		for (TObjectIterator<UCharacterStateMachine> It; It; ++It)
+		{
+			if (It->GetWorld() != World) continue;
+
+			OwnBytes += It->GetClass()->GetStructureSize() + It->GetResourceSizeBytes(EResourceSizeMode::Exclusive);
+			CopiedBytes += sizeof(FCharacterStateMachineDefinition);
+			NumMachines++;
+
+			for (const FMechanicStateData& Mechanic : It->GetMechanics())
+			{
+				const UStateComponentBase& Component = *Mechanic.Component;
+				OwnBytes += Component.GetClass()->GetStructureSize() + Mechanic.Component->GetResourceSizeBytes(EResourceSizeMode::Exclusive);
+				CopiedBytes += sizeof(FStateMechanicSettings);
+				if (const UStateComponentBase* Template = Cast<UStateComponentBase>(Component.GetArchetype()))
+				{
+					FreedContainerBytes += FMath::Max<int64>(Template->GetEditableSettingsSize() - Component.GetEditableSettingsSize(), 0);
+				}
+				NumMechanics++;
+			}
+		}
+
+		if (NumMachines == 0)
+		{
+			UE_LOG(LogTemp, Log, TEXT("No state machines in the world."));
+			return;
+		}
+
+		int32 NumSharedSettings = 0;
+		const int64 SharedBytes = SharedDefinitions.GetAllocatedSize() + UStateComponentBase::GetSharedSettingsSize(NumSharedSettings);
+		const double OwnPerCharacter = static_cast<double>(OwnBytes) / NumMachines;
+		const double UnsharedEstimatePerCharacter = OwnPerCharacter + static_cast<double>(FreedContainerBytes + CopiedBytes) / NumMachines;
+		const double AfterPerCharacter = OwnPerCharacter + static_cast<double>(SharedBytes) / NumCharacters;
+
+		UE_LOG(LogTemp, Log, TEXT("State machine memory: %d machines, %d mechanics, %.0f bytes own per character. Shared: %lld bytes in %d definitions and %d mechanic settings."),
+			NumMachines, NumMechanics, OwnPerCharacter, SharedBytes, SharedDefinitions.Num(), NumSharedSettings);
+		UE_LOG(LogTemp, Log, TEXT("At %d characters: %.0f bytes per character measured, an estimated %.0f without sharing (%.0f of containers freed by Definitions, %.0f of copies)."),
+			NumCharacters, AfterPerCharacter, UnsharedEstimatePerCharacter, static_cast<double>(FreedContainerBytes) / NumMachines, static_cast<double>(CopiedBytes) / NumMachines);
+	}));
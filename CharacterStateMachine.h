@@ -4,6 +4,11 @@
 
 #include "CoreMinimal.h"
 #include "Components/ActorComponent.h"
+#include "Engine/Engine.h"
+#include "StateMachineCore.h"
+#include "StateMachineProfiler.h"
+#include "StateMachineSnapshot.h"
+#include "StateMachineTraceRecorder.h"
 #include "CharacterStateMachine.generated.h"
 
 //Using custom enum types and translating back and forth because I cannot make UInterface as making it would make it a UObject,
@@ -14,6 +19,9 @@
 //todo rewrite and shorten
 
 class UStateComponentBase;
+class UStateMachineConfig;
+class UCharacterStateMachineSubsystem;
+class UCharacterMovementComponent;
 
 UENUM(BlueprintType)
 enum class ECharacterState : uint8
@@ -24,7 +32,147 @@ enum class ECharacterState : uint8
 	WallRunning,
 	AirDashing,
 	// Add other states as needed
+
+	//Keep this last. It is the number of states, used to size the compiled lookup tables.
+	Count UMETA(Hidden)
+};
+
+constexpr int32 NumCharacterStates = static_cast<int32>(ECharacterState::Count);
+
+//Dense NxN bit matrix baked from every mechanic's CanTransitionFromStateList in SetupStateMachine, or when a UStateMachineConfig is saved.
+//The TMap on the components stays the editor-facing source of truth, this is only the compiled form of it.
+using FStateTransitionTable = StateMachineCore::TTransitionTable<ECharacterState, NumCharacterStates>;
+using FStateDetectionStats = StateMachineCore::FDetectionStats;
+using FCharacterStateMachineCore = StateMachineCore::TStateMachineCore<ECharacterState, UStateComponentBase, NumCharacterStates>;
+//Compiled hierarchy, regions, guards and transition table. One is shared by every machine set up the same way.
+using FCharacterStateMachineDefinition = FCharacterStateMachineCore::FDefinition;
+using FCharacterStateMachineProfiler = TStateMachineProfiler<ECharacterState, NumCharacterStates>;
+
+//Snapshot of everything detectors can declare a dependency on, gathered once per detection run.
+struct FStateDetectionContext
+{
+	FVector Velocity = FVector::ZeroVector;
+	double Time = 0;
+	uint32 InputSerial = 0;
+	//Current state of every region, see StateMachineCore::TStateMachineCore::GetActiveMask.
+	uint64 ActiveStates = 0;
+	bool Grounded = false;
+};
+
+//Per-character values detection predicates can test. Gathered once per detection, see UCharacterStateMachine::GatherPredicateInputs.
+UENUM(BlueprintType)
+enum class EStatePredicateInput : uint8
+{
+	//Length of the owner's velocity on the ground plane.
+	HorizontalSpeed,
+	//Z of the owner's velocity, negative while falling.
+	VerticalSpeed,
+	//1 while the owner is moving on ground, 0 otherwise.
+	Grounded,
+	//Seconds since the owner was last on ground, 0 while it is.
+	AirTime,
+	//Length of the last movement input.
+	MovementInput,
+	//Seconds since region 0 of the state machine last changed state.
+	TimeInState,
+	//Set by game code through UCharacterStateMachine::SetCustomPredicateInput, for things like dash availability.
+	Custom0,
+	Custom1,
+
+	Count UMETA(Hidden)
+};
+
+constexpr int32 NumPredicateInputs = static_cast<int32>(EStatePredicateInput::Count);
+
+UENUM(BlueprintType)
+enum class EStatePredicateComparison : uint8
+{
+	AtLeast,
+	Below,
+};
+
+//One condition of a detection predicate, Input compared against Threshold.
+USTRUCT(BlueprintType)
+struct FStatePredicateTerm
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere)
+	EStatePredicateInput Input = EStatePredicateInput::HorizontalSpeed;
+
+	UPROPERTY(EditAnywhere)
+	EStatePredicateComparison Comparison = EStatePredicateComparison::AtLeast;
+
+	UPROPERTY(EditAnywhere)
+	float Threshold = 0;
+
+	bool operator==(const FStatePredicateTerm& Other) const
+	{
+		return Input == Other.Input && Comparison == Other.Comparison && Threshold == Other.Threshold;
+	}
+
+	bool Evaluate(const float* Inputs) const
+	{
+		const bool AtLeast = Inputs[static_cast<uint8>(Input)] >= Threshold;
+		return Comparison == EStatePredicateComparison::AtLeast ? AtLeast : !AtLeast;
+	}
+};
+
+//Per-frame input channels a state can override.
+UENUM(meta = (Bitflags, UseEnumValuesAsMaskValuesInEditor = "true"))
+enum class EStateInputChannel : uint8
+{
+	None = 0 UMETA(Hidden),
+	Movement = 1 << 0,
+	Acceleration = 1 << 1,
+	Camera = 1 << 2,
+	All = Movement | Acceleration | Camera UMETA(Hidden),
+};
+ENUM_CLASS_FLAGS(EStateInputChannel);
+
+//Every per-frame input channel, handed to the current state in one go by ApplyOverrides.
+struct FStateInputOverrides
+{
+	FVector2d MovementVector = FVector2d::ZeroVector;
+	float Acceleration = 0;
+	FVector2d CameraRotation = FVector2d::ZeroVector;
+
+	//Channels the caller filled in. Channels not set here are left alone.
+	EStateInputChannel Channels = EStateInputChannel::All;
+
+	//Channels whose value differs from Other.
+	EStateInputChannel GetChangedChannels(const FStateInputOverrides& Other) const
+	{
+		EStateInputChannel Changed = EStateInputChannel::None;
+		if (MovementVector != Other.MovementVector) Changed |= EStateInputChannel::Movement;
+		if (Acceleration != Other.Acceleration) Changed |= EStateInputChannel::Acceleration;
+		if (CameraRotation != Other.CameraRotation) Changed |= EStateInputChannel::Camera;
+		return Changed;
+	}
+};
+
+//Fixed part of a machine snapshot. It is followed by the snapshot data of every mechanic that has any, in MechanicsList order,
+//see UStateComponentBase::SaveSnapshot.
+struct FStateMachineSnapshotHeader
+{
+	double LastUpdateTime;
+	double TimeAccumulator;
+	double SimulationTime;
+	double StateEnterTime;
+	double LastGroundedTime;
+	FVector2d LastMovementInput;
+	uint64 PendingRequestMask;
+	uint32 InputSerial;
+	float UpdateDeltaTime;
+	float CustomPredicateInputs[2];
+	uint32 RunUpdateMask;
+	//Current state of each region, FCharacterStateMachineCore::NoState where a region has none.
+	uint8 CurrentStates[FCharacterStateMachineCore::MaxNumRegions];
+	uint8 UpdateInterval;
 };
+static_assert(std::is_trivially_copyable_v<FStateMachineSnapshotHeader>, "Snapshots are copied as raw bytes.");
+
+DECLARE_MULTICAST_DELEGATE_TwoParams(FOnStateRequestRejected, ECharacterState /*Requested*/, StateMachineCore::ESetStateResult /*Reason*/);
 
 USTRUCT(BlueprintType)
 struct FMechanicStateData
@@ -47,6 +195,52 @@ struct FMechanicStateData
 	{}
 };
 
+USTRUCT(BlueprintType)
+struct FStateMachineLODLevel
+{
+	GENERATED_BODY()
+
+	//Distance to the local camera from which this level applies.
+	UPROPERTY(EditAnywhere, meta = (ClampMin = 0))
+	float MinDistance = 0;
+
+	//Update and detection run every Nth frame at this level.
+	UPROPERTY(EditAnywhere, meta = (ClampMin = 1, ClampMax = 255))
+	int32 FrameInterval = 1;
+
+	FStateMachineLODLevel() = default;
+
+	FStateMachineLODLevel(const float InMinDistance, const int32 InFrameInterval)
+		: MinDistance(InMinDistance), FrameInterval(InFrameInterval)
+	{}
+};
+
+//A layer of states with its own current state, running alongside MechanicsHierarchy or nested under one of its states.
+//For example upper body actions next to locomotion, or the phases of a wall run.
+USTRUCT(BlueprintType)
+struct FStateMachineRegion
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere)
+	FName Name;
+
+	//Mechanics of this region in priority order. The region starts in the first one.
+	UPROPERTY(EditAnywhere)
+	TArray<ECharacterState> MechanicsHierarchy;
+
+	//Makes this a sub-state region that only runs while ParentState is active. Otherwise it runs for as long as the machine has a state.
+	UPROPERTY(EditAnywhere)
+	bool NestedInState = false;
+
+	//Has to be in MechanicsHierarchy of the machine or of a region listed before this one.
+	UPROPERTY(EditAnywhere, meta = (EditCondition = "NestedInState"))
+	ECharacterState ParentState = ECharacterState::DefaultState;
+};
+
+struct FStateMechanicArchetype;
+struct FStateMechanicSettings;
+
 UCLASS(ClassGroup=(Custom), meta=(BlueprintSpawnableComponent))
 class CHASING_5SD073_API UCharacterStateMachine : public UActorComponent
 {
@@ -59,58 +253,411 @@ public:
 protected:
 	// Called when the game starts
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
 public:
 	// Called every frame
 	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
 
+#if WITH_EDITOR
+	//Rejects duplicate states and broken regions when the owner is saved or validated, instead of pausing the game at setup.
+	virtual EDataValidationResult IsDataValid(FDataValidationContext& Context) const override;
+#endif
+
 	//This switches states. Returns true if successful
+	//With DeferTransitions on, this only requests the state, see RequestState. It returns false right away for unassigned states
+	//and transitions the table does not allow, and true for everything the commit could still apply.
 	UFUNCTION(BlueprintCallable)
 	bool SetState(const ECharacterState& NewStateEnum);
+
+	//Queues a transition for the next commit point instead of switching right away. All requests made in between are resolved by
+	//MechanicsHierarchy priority and only the winner is entered, the others are reported through OnStateRequestRejected.
+	UFUNCTION(BlueprintCallable)
+	void RequestState(const ECharacterState& NewStateEnum);
+
+	//Applies queued requests. DetectStates and the batched subsystem call this every frame, after detection.
+	void CommitTransitions();
+
+	FOnStateRequestRejected& OnStateRequestRejected() { return StateRequestRejectedEvent; }
+
+	//Sets Custom0 or Custom1 for detection predicates, for values only game code knows, like whether a dash is available.
+	//Other inputs are tracked by the machine and ignored here.
+	UFUNCTION(BlueprintCallable)
+	void SetCustomPredicateInput(const EStatePredicateInput Input, const float Value);
+	float GetCustomPredicateInput(const EStatePredicateInput Input) const;
+
+	FVector2d GetLastMovementInput() const { return LastMovementInput; }
+
+	//States gameplay code asked for through SetState or RequestState since the last call, leaving out the ones detectors asked for.
+	//Read by input recording, see FStateMachineInputRecording.
+	uint64 ConsumeExternalRequests()
+	{
+		const uint64 Requests = ExternalRequestMask;
+		ExternalRequestMask = 0;
+		return Requests;
+	}
+
+	FStateMachineTraceRecorder& GetTraceRecorder() { return TraceRecorder; }
+
+	//Dispatch timings and state histograms since BeginPlay. Empty when WITH_STATE_MACHINE_PROFILING is off.
+	const FCharacterStateMachineProfiler& GetProfiler() const { return Profiler; }
+
+	//Writes the transition trace to FilePath, or to Saved/StateMachineTraces when empty. Convert it with Tools/StateMachineTraceToTimeline.py.
+	UFUNCTION(BlueprintCallable)
+	bool DumpTransitionTrace(const FString& FilePath);
+	//Owners should not call UpdateStateMachine and DetectStates when UseBatchedUpdate is on, the subsystem runs them instead.
 	void UpdateStateMachine();
 	void ManualExitState();
 	void DetectStates();
 	void SetupStateMachine();
 
+	//For pooled owners. Drops the current states without exit callbacks and clears pending requests and detection gating, keeping
+	//the resolved mechanics and the compiled table, so a reused actor is set up again without any lookups or allocations.
+	//Set the starting state again afterwards, like after SetupStateMachine.
+	UFUNCTION(BlueprintCallable)
+	void ResetForReuse();
+
+	//Rollback support. A snapshot is GetSnapshotSize bytes, an FStateMachineSnapshotHeader followed by the mechanics' own data.
+	//The size is fixed once SetupStateMachine has run, so buffers can be allocated once and snapshots delta encoded against each
+	//other with StateMachineCore::EncodeDelta.
+	int32 GetSnapshotSize() const { return sizeof(FStateMachineSnapshotHeader) + MechanicSnapshotSize; }
+	void SaveSnapshot(uint8* Buffer) const;
+	//Puts the machine back without calling enter or exit. Detection gating starts over, so every detector runs on the next detection.
+	void RestoreSnapshot(const uint8* Buffer);
+
+	//Runs all per-frame input overrides of the current state in one dispatch. Prefer this over the three separate calls below.
+	void ApplyOverrides(FStateInputOverrides& Inputs);
 	void OverrideMovementInput(FVector2d& NewMovementVector);
 	void OverrideAcceleration(float& NewSpeed);
 	void OverrideCameraInput(FVector2d& NewRotationVector);
 	void OverrideDebug() const;
 
-	bool IsThisCurrentState(const UStateComponentBase& Component) const { return CurrentState == &Component; }
-	bool IsCurrentStateNull() const { return CurrentState == nullptr; }
+	//Rebuilds the list of mechanics OverrideDebug runs. Call it after changing DebugMechanic on a mechanic at runtime.
+	void RefreshDebugMechanics();
+
+	//True if the component is the current state of any region.
+	bool IsThisCurrentState(const UStateComponentBase& Component) const
+	{
+		for (int32 Region = 0; Region < Core.GetNumRegions(); ++Region)
+		{
+			if (Core.GetCurrentState(Region) == &Component) return true;
+		}
+		return false;
+	}
+	bool IsCurrentStateNull() const { return Core.GetCurrentState() == nullptr; }
 
 	
-	UStateComponentBase* GetCurrentState() const { return CurrentState; }
+	UStateComponentBase* GetCurrentState() const { return Core.GetCurrentState(); }
+
+	UFUNCTION(BlueprintPure)
+	FORCEINLINE ECharacterState GetCurrentEnumState() const { return Core.GetCurrentEnumState(); }
 
+	//Region 0 is MechanicsHierarchy, the ones after it follow the Regions array. Regions that failed to set up are skipped.
 	UFUNCTION(BlueprintPure)
-	FORCEINLINE ECharacterState GetCurrentEnumState() const { return CurrentEnumState; }
+	ECharacterState GetCurrentEnumStateInRegion(const int32 Region) const
+	{
+		return Region >= 0 && Region < Core.GetNumRegions() ? Core.GetCurrentEnumState(Region) : ECharacterState::DefaultState;
+	}
+
+	//Whether the state is the current state of its region.
+	UFUNCTION(BlueprintPure)
+	bool IsStateActive(const ECharacterState State) const { return Core.IsActive(State); }
+
+	//Mask of the current state of every region.
+	uint64 GetActiveStateMask() const { return Core.GetActiveMask(); }
+
+	//Time since this machine last ran its update. With LOD scheduling on, this is the delta accumulated over every skipped frame.
+	//In fixed timestep mode it is the fixed step.
+	UFUNCTION(BlueprintPure)
+	FORCEINLINE float GetUpdateDeltaTime() const { return UpdateDeltaTime; }
+
+	//How far the frame is between the last fixed step and the next one, 0 to 1. Rendering blends the previous and current
+	//simulated transforms by it. Always 1 outside of fixed timestep mode.
+	UFUNCTION(BlueprintPure)
+	FORCEINLINE float GetInterpolationAlpha() const { return InterpolationAlpha; }
+
+	//Time simulated by fixed steps since setup. Detection timers use it instead of the world clock in fixed timestep mode.
+	double GetSimulationTime() const { return SimulationTime; }
+
+	bool UsesFixedTimestep() const { return UseFixedTimestep; }
+
+	//Turns fixed timestep mode on or off at runtime, not from inside the batched update. Detection timers, time in state and air
+	//time keep counting on the clock they started on, call ResetForReuse afterwards to restart them on the new one.
+	void SetUseFixedTimestep(const bool Enable);
+
+	//Runs NumSteps steps back to back, each an update followed by detection and the commit of requested transitions. Nothing here
+	//reads the engine clock, so a headless loop can simulate faster than real time, for batch simulation and automated tests.
+	void SimulateSteps(const int32 NumSteps, const float DeltaTime);
+
+	//Whether the LOD schedule lets this machine update and detect on the given frame.
+	FORCEINLINE bool IsDueOnFrame(const uint64 FrameNumber) const { return (FrameNumber + LODPhase) % UpdateInterval == 0; }
+
+	bool IsBatched() const { return BatchIndex != INDEX_NONE; }
+	bool UsesParallelDetection() const { return UseParallelDetection; }
+	const FStateDetectionStats& GetDetectionStats() const { return Core.GetDetectionStats(); }
+
+	const TArray<FMechanicStateData>& GetMechanics() const { return MechanicsList; }
+
+	//Writes one value per EStatePredicateInput, each to Columns[Input][Index]. The batched subsystem has every machine write
+	//straight into its slot of the subsystem's input columns while preparing detection.
+	void GatherPredicateInputs(float* const* Columns, const int32 Index) const;
+	//Mask of states whose predicate holds, over every mechanic with one. Unbatched machines and machines the subsystem could not
+	//fit into its vector pass evaluate their predicates here, one machine at a time.
+	uint64 EvaluatePredicates() const;
+	//States whose mechanic has a detection predicate.
+	uint64 GetPredicateStateMask() const { return PredicateStateMask; }
+
+	//The compiled definition this machine points at, shared with every machine set up the same way.
+	const FCharacterStateMachineDefinition& GetDefinition() const { return Core.GetDefinition(); }
+
+	//Compiles a hierarchy and its regions. FindSettings returns the settings of the mechanic for a state, or null to leave it out.
+	//Used by setup, and by UStateMachineConfig to do the same work once when it is saved.
+	static void BuildDefinition(FCharacterStateMachineDefinition& Definition, const TArray<ECharacterState>& Hierarchy,
+		const TArray<FStateMachineRegion>& InRegions, const TFunctionRef<const FStateMechanicSettings*(ECharacterState)> FindSettings);
+
+	//Checks a hierarchy and its regions the way setup uses them. Adds an error for every problem and returns true if there were none.
+	static bool ValidateHierarchy(const TArray<ECharacterState>& Hierarchy, const TArray<FStateMachineRegion>& InRegions, TArray<FText>& OutErrors);
+
+	//Counts the containers of this machine, for memreport and StateMachine.MemoryReport. The mechanics and the shared definition
+	//are not counted here.
+	virtual void GetResourceSizeEx(FResourceSizeEx& CumulativeResourceSize) override;
 
 private:
-	static FString EnumToString(const ECharacterState& ToConvert);
-	void CheckForDuplicates();
-	void GetComponentReferences(const TArray<ECharacterState>& HierarchyArray);
-	UStateComponentBase* TranslateEnumToState(const ECharacterState& Enum) const;
+	friend class UCharacterStateMachineSubsystem;
+
+	void RunStateUpdate();
+	void RunDetection();
+
+	//A single simulation step: the update with an explicit delta, then, when Detect is set, detection and the commit.
+	void StepStateMachine(const float DeltaTime, const bool Detect);
+	//NumSteps detecting steps in one engine frame, with the frame's trace resolve before them and its submit after them.
+	void RunSteps(const int32 NumSteps, const float DeltaTime);
+
+	//First phase of parallel detection. Safe to call from worker threads, returns the mask of states whose mechanics want to be entered.
+	uint64 QueryDetectStates(const uint64 DetectableMask) const;
+	//Second phase of parallel detection, game thread only. Commits the candidates in hierarchy order. CandidateMask holds the
+	//batched predicate results, and the queried candidates too when Queried is set.
+	void CommitDetectedStates(const uint64 CandidateMask, const bool Queried);
+	//Shared detection loop. Walks mechanics in hierarchy order, a region stops detecting at the first one that switches its state.
+	//Predicate mechanics are entered when their bit is set in CandidateMask, whether or not UseQueriedCandidates is.
+	void DetectInPriorityOrder(const bool UseQueriedCandidates, const uint64 CandidateMask);
+
+	//Game thread work that has to happen before detectors run, reading back traces and working out which detectors are dirty.
+	void PrepareDetection();
 
-	//Add quick debug text with red color and 0 lifetime
-	static void DebugText(const FString& Text);
+	//Mechanics queue their traces during detection. Last frame's results are read back before it, this frame's are submitted after it.
+	//Machines the LOD schedule skips next frame still read theirs back then, see TraceSubmitFrame.
+	void ResolveMechanicTraces();
+	void SubmitMechanicTraces();
+
+	//Returns the mask of mechanics whose detection dependencies changed, see UStateComponentBase::DetectionDependencies.
+	uint64 GatherDirtyDetectors();
+
+	void TrackMovementInput(const FVector2d& NewMovementVector);
+
+	//The clock detection reads, the simulated one in fixed timestep mode.
+	double GetDetectionTime() const;
+
+	//Mask of assigned states this machine could enter from the current state of their region, excluding the current states.
+	uint64 GetDetectableMask() const { return Core.GetDetectableMask(); }
+
+	//Pushes the hot state into the subsystem's arrays. Called whenever it changes.
+	void SyncBatchedState() const;
+
+	//Picks the update interval from LODLevels based on the distance to the local camera.
+	void EvaluateLOD();
+
+	//Switches state right away, this is what SetState does when transitions are not deferred.
+	StateMachineCore::ESetStateResult ApplyState(const ECharacterState& NewStateEnum);
+	void ReportRejectedRequest(const ECharacterState State, const StateMachineCore::ESetStateResult Reason);
+
+	//Current state of State's region, as stored in trace records.
+	uint8 TraceStateIndex(const ECharacterState State) const;
+
+	//Probe the core's dispatches go through. Records enter and exit in the trace and times every call in the profiler.
+	auto MakeDispatchProbe()
+	{
+		return [this](const ECharacterState State, const StateMachineCore::EStateDispatch Dispatch, auto&& Call) -> decltype(auto)
+		{
+			if (Dispatch == StateMachineCore::EStateDispatch::Enter)
+			{
+				TraceRecorder.Record(EStateTraceEvent::Enter, static_cast<uint8>(State), FStateMachineTraceRecorder::NoState);
+			}
+			else if (Dispatch == StateMachineCore::EStateDispatch::Exit)
+			{
+				TraceRecorder.Record(EStateTraceEvent::Exit, static_cast<uint8>(State), FStateMachineTraceRecorder::NoState);
+			}
+			return Profiler(State, Dispatch, Call);
+		};
+	}
+
+	//Runs Func on the current state of every region.
+	template <typename FuncType>
+	void ForEachCurrentState(FuncType&& Func) const
+	{
+		for (int32 Region = 0; Region < Core.GetNumRegions(); ++Region)
+		{
+			if (UStateComponentBase* State = Core.GetCurrentState(Region)) Func(*State);
+		}
+	}
+
+	//Short name of the state, from a table built once on first use.
+	static const FString& EnumToString(const ECharacterState& ToConvert);
+	//The two ways SetupStateMachine fills MechanicsList and the core. Return false if the machine could not be set up.
+	bool SetupFromConfig();
+	bool SetupFromHierarchy();
+	static const FStateMechanicArchetype& FindOrAddArchetype(const UClass& OwnerClass);
+	//Mechanic of State on Owner. AllowNameLookup searches the components by name when the owner class has no property for it.
+	static UStateComponentBase* FindMechanic(AActor& Owner, const FStateMechanicArchetype& Archetype, const ECharacterState State, const bool AllowNameLookup);
+	//Points the core at the shared copy of Definition, adding it if no machine is set up this way yet, and gives back the one it
+	//had. ReleaseSharedDefinition gives it back and leaves the machine without one, a definition is freed with its last machine.
+	void SetSharedDefinition(const FCharacterStateMachineDefinition& Definition);
+	void ReleaseSharedDefinition();
+	void BuildSnapshotLayout();
+	FORCEINLINE UStateComponentBase* TranslateEnumToState(const ECharacterState& Enum) const
+	{
+		checkSlow(Enum < ECharacterState::Count);
+		return Core.Translate(Enum);
+	}
+
+	//True when DebugStateMachine is on and on screen messages can be shown.
+	bool IsDebugSinkActive() const { return DebugStateMachine && GEngine != nullptr && GAreScreenMessagesEnabled; }
+
+	//Add quick debug text with red color, 0 lifetime by default. Format returns the text and is only called when the debug sink
+	//is active, so nothing is formatted or allocated otherwise.
+	template <typename FormatType>
+	void DebugText(FormatType&& Format, const float Duration = 0) const
+	{
+		if (IsDebugSinkActive()) GEngine->AddOnScreenDebugMessage(-1, Duration, FColor::Red, Format());
+	}
+
+	UPROPERTY(EditAnywhere, Category= "Character State Machine",
+		meta = (ToolTip = "Hierarchy, regions and transitions validated and compiled when the asset is saved. When set, Mechanics Hierarchy and Regions are ignored."))
+	UStateMachineConfig* Config = nullptr;
 
 	UPROPERTY(EditAnywhere, Category= "Character State Machine")
 	TArray<ECharacterState> MechanicsHierarchy;
+
+	UPROPERTY(EditAnywhere, Category= "Character State Machine",
+		meta = (ToolTip = "Extra layers of states with their own current state, sharing this machine's transition table, update and detection. A state can only be in one of them."))
+	TArray<FStateMachineRegion> Regions;
 	
+	//Mirror of the core's current state for the details panel. Code should read GetCurrentEnumState instead.
 	UPROPERTY(VisibleAnywhere, Category= "Character State Machine", DisplayName= "Current State")
 	ECharacterState CurrentEnumState = ECharacterState::DefaultState;
 
 	UPROPERTY(EditAnywhere, Category= "Character State Machine|Debug")
 	bool DebugStateMachine = false;
+
+	UPROPERTY(EditAnywhere, Category= "Character State Machine|Debug", meta = (ClampMin = 0,
+		ToolTip = "Number of 16 byte records kept by the transition trace recorder, rounded up to a power of two. Zero turns it off."))
+	int32 TraceCapacity = 256;
+
+	UPROPERTY(EditAnywhere, Category= "Character State Machine|Debug", meta = (EditCondition = "TraceCapacity > 0",
+		ToolTip = "Also records every detector run and its cost. Detectors run every frame, so this fills the trace buffer within a few frames."))
+	bool TraceDetectors = false;
+
+	UPROPERTY(EditAnywhere, Category= "Character State Machine|Performance",
+		meta = (ToolTip = "Registers this machine with the world subsystem, which updates and detects all registered machines in one batched pass per frame."))
+	bool UseBatchedUpdate = false;
+
+	UPROPERTY(EditAnywhere, Category= "Character State Machine|Performance", meta = (EditCondition = "UseBatchedUpdate",
+		ToolTip = "Runs QueryDetectState of mechanics that support it on worker threads, then commits the results on the game thread."))
+	bool UseParallelDetection = false;
+
+	UPROPERTY(EditAnywhere, Category= "Character State Machine|Performance",
+		meta = (ToolTip = "Turns every SetState into a request. Requests made during a frame are resolved by hierarchy priority and applied once, after detection."))
+	bool DeferTransitions = false;
+
+	UPROPERTY(EditAnywhere, Category= "Character State Machine|Timestep",
+		meta = (ToolTip = "Simulates in fixed steps instead of once per frame, so states behave the same at any frame rate. Detection runs after every step, DetectStates only commits requests."))
+	bool UseFixedTimestep = false;
+
+	UPROPERTY(EditAnywhere, Category= "Character State Machine|Timestep", meta = (EditCondition = "UseFixedTimestep", ClampMin = 0.001, Units = "s"))
+	float FixedTimestep = 1.0f / 60.0f;
+
+	UPROPERTY(EditAnywhere, Category= "Character State Machine|Timestep", meta = (EditCondition = "UseFixedTimestep", ClampMin = 1,
+		ToolTip = "Most steps run in one frame. Time beyond that is dropped, so a long hitch slows the simulation down instead of stalling the game."))
+	int32 MaxSubsteps = 8;
+
+	UPROPERTY(EditAnywhere, Category= "Character State Machine|LOD",
+		meta = (ToolTip = "Lowers how often update and detection run for machines far from the local camera."))
+	bool UseLODScheduling = false;
+
+	UPROPERTY(EditAnywhere, Category= "Character State Machine|LOD", meta = (EditCondition = "UseLODScheduling",
+		ToolTip = "Sorted by MinDistance. The furthest level the owner is beyond is used."))
+	TArray<FStateMachineLODLevel> LODLevels = { FStateMachineLODLevel(0, 1), FStateMachineLODLevel(2000, 4), FStateMachineLODLevel(5000, 16) };
 	
+	//Mirror of the core's current state pointer, same as CurrentEnumState.
 	UPROPERTY(VisibleAnywhere,Category= "Character State Machine|Debug", DisplayName= "Current State Internal")
 	UStateComponentBase* CurrentState = nullptr;
 	
 	UPROPERTY(VisibleAnywhere, Category= "Character State Machine|Debug")
 	TArray<FMechanicStateData> MechanicsList;
 
-	
-	bool RunUpdate = false;
+	//Mechanics with DebugMechanic set, so OverrideDebug does not walk MechanicsList every frame. See RefreshDebugMechanics.
+	UPROPERTY()
+	TArray<UStateComponentBase*> DebuggedMechanics;
+
+	//Enum indexed dispatch and the detection loop, over the shared definition. MechanicsList keeps the components referenced for GC,
+	//the core only holds raw pointers to them.
+	FCharacterStateMachineCore Core;
+	//What the core points at, held until the machine is set up again or ends play.
+	const FCharacterStateMachineDefinition* SharedDefinition = nullptr;
+
+	//States requested since the last commit.
+	uint64 PendingRequestMask = 0;
+
+	//Total snapshot data of all mechanics, and where each mechanic's starts. Parallel to MechanicsList, worked out in setup.
+	int32 MechanicSnapshotSize = 0;
+	TArray<int32> MechanicSnapshotOffsets;
+
+	FOnStateRequestRejected StateRequestRejectedEvent;
+
+	FStateMachineTraceRecorder TraceRecorder;
+	FCharacterStateMachineProfiler Profiler;
+
+	//Mechanics that need to run detection this frame, filled by PrepareDetection.
+	uint64 DirtyDetectorMask = 0;
+
+	//Last frame any mechanic submitted async traces. Their results have to be read back on the next frame, due or not.
+	uint64 TraceSubmitFrame = 0;
+
+	//Bumped whenever the movement input changes, so detectors depending on input can tell.
+	uint32 InputSerial = 0;
+	FVector2d LastMovementInput = FVector2d::ZeroVector;
+
+	//Detection predicate inputs the machine tracks itself, see GatherPredicateInputs.
+	uint64 PredicateStateMask = 0;
+	double StateEnterTime = 0;
+	double LastGroundedTime = 0;
+	float CustomPredicateInputs[2] = {};
+
+	//See ConsumeExternalRequests. Detecting is set while detectors run, so their requests are left out.
+	uint64 ExternalRequestMask = 0;
+	bool Detecting = false;
+	//Set when the running detector requested a state, even one that was already queued, which settles its region.
+	bool DetectorRequested = false;
+
+	UPROPERTY()
+	UCharacterMovementComponent* OwnerMovement = nullptr;
+
+	//Current LOD interval in frames, and a per-machine offset so machines on the same interval do not all run on the same frame.
+	uint8 UpdateInterval = 1;
+	uint8 LODPhase = 0;
+
+	float UpdateDeltaTime = 0;
+	double LastUpdateTime = 0;
+
+	//Fixed timestep state. Time carried over to the next frame, and the simulated clock.
+	double TimeAccumulator = 0;
+	double SimulationTime = 0;
+	float InterpolationAlpha = 1;
+
+	//Slot in UCharacterStateMachineSubsystem's arrays, INDEX_NONE when not batched.
+	int32 BatchIndex = INDEX_NONE;
+
+	UPROPERTY(Transient)
+	UCharacterStateMachineSubsystem* BatchSubsystem = nullptr;
 };
 
@@ -0,0 +1,473 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "CharacterStateMachineSubsystem.h"
+#include "StateComponentBase.h"
+#include "Async/ParallelFor.h"
+
+namespace
+{
+	//Each bit of a four lane compare mask spread over a 64 bit lane, so a passed term is ORed into four machines with two vector ORs.
+	struct FLaneSpread
+	{
+		alignas(16) uint64 Masks[16][4];
+
+		FLaneSpread()
+		{
+			for (int32 Held = 0; Held < 16; ++Held)
+			{
+				for (int32 Lane = 0; Lane < 4; ++Lane) Masks[Held][Lane] = (Held >> Lane) & 1 ? ~uint64(0) : 0;
+			}
+		}
+	};
+	const FLaneSpread LaneSpread;
+}
+
+void UCharacterStateMachineSubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	TGuardValue<bool> TickingGuard(bTicking, true);
+	const int32 Num = Machines.Num();
+
+	//Last frame's async traces are only held by the world this frame, so they are read back before the LOD schedule skips anyone.
+	for (UCharacterStateMachine* Machine : PendingTraceResolves)
+	{
+		if (Machine != nullptr) Machine->ResolveMechanicTraces();
+	}
+	PendingTraceResolves.Reset();
+
+	//LOD schedule. Machines that are not due this frame are skipped by both passes.
+	for (int32 Index = 0; Index < Num; ++Index)
+	{
+		DueFlags[Index] = (GFrameCounter + LODPhases[Index]) % UpdateIntervals[Index] == 0;
+	}
+
+	//Update pass. Only machines with a running state are dereferenced.
+	for (int32 Index = 0; Index < Num; ++Index)
+	{
+		if (DueFlags[Index] && RunUpdateFlags[Index])
+		{
+			Machines[Index]->RunStateUpdate();
+		}
+	}
+
+	//Async trace results and dirty detectors have to be worked out on the game thread, before the queries and predicates that use
+	//them. Batched predicate machines write their inputs into the columns while they are at it.
+	const bool BatchPredicates = NumPredicateMachines >= MinBatchedPredicateMachines;
+	if (NumParallelMachines > 0 || NumPredicateMachines > 0)
+	{
+		for (int32 Index = 0; Index < Num; ++Index)
+		{
+			if (!IsDetectionDue(Index) || !(ParallelDetectionFlags[Index] || HasPredicates(Index))) continue;
+
+			Machines[Index]->PrepareDetection();
+			if (BatchPredicates && PredicateStates[Index] != 0)
+			{
+				//Fetched per machine, a machine registered by PrepareDetection may have grown the columns.
+				float* Columns[NumPredicateInputs];
+				for (int32 Input = 0; Input < NumPredicateInputs; ++Input) Columns[Input] = PredicateInputs[Input].GetData();
+				Machines[Index]->GatherPredicateInputs(Columns, Index);
+			}
+		}
+	}
+
+	//Query phase of parallel detection. Read-only, each worker only writes its own candidate slot.
+	if (NumParallelMachines > 0)
+	{
+		ParallelFor(Num, [this](const int32 Index)
+		{
+			CandidateMasks[Index] = IsDetectionDue(Index) && ParallelDetectionFlags[Index]
+				? Machines[Index]->QueryDetectStates(TransitionMasks[Index])
+				: 0;
+		});
+	}
+
+	if (NumPredicateMachines > 0)
+	{
+		EvaluatePredicates(BatchPredicates);
+	}
+
+	FrameDetectionStats = FStateDetectionStats();
+
+	//Detection and commit pass. Machines with no reachable state are skipped. A machine that switches state here re-syncs its own
+	//slot. One that is unregistered here, its own or any other, only has its slot nulled, so the arrays stay valid through the loop.
+	for (int32 Index = 0; Index < Num; ++Index)
+	{
+		if (!IsDetectionDue(Index)) continue;
+
+		UCharacterStateMachine* Machine = Machines[Index];
+		if (ParallelDetectionFlags[Index] || HasPredicates(Index))
+		{
+			Machine->CommitDetectedStates(CandidateMasks[Index], ParallelDetectionFlags[Index]);
+		}
+		else
+		{
+			Machine->RunDetection();
+		}
+		FrameDetectionStats += Machine->GetDetectionStats();
+	}
+
+	//Commit point for requested transitions. Requests made while committing are appended and wait for the next frame.
+	const int32 NumCommits = PendingCommits.Num();
+	for (int32 Index = 0; Index < NumCommits; ++Index)
+	{
+		if (PendingCommits[Index] != nullptr) PendingCommits[Index]->CommitTransitions();
+	}
+	PendingCommits.RemoveAt(0, NumCommits);
+
+	//Highest first, so every slot moved into a removed one is already a live machine.
+	for (int32 Index = Machines.Num() - 1; NumRemovedSlots > 0 && Index >= 0; --Index)
+	{
+		if (Machines[Index] != nullptr) continue;
+		RemoveSlot(Index);
+		NumRemovedSlots--;
+	}
+}
+
+void UCharacterStateMachineSubsystem::EvaluatePredicates(const bool Batched)
+{
+	const int32 Num = Machines.Num();
+	const int32 NumPadded = Align(Num, 4);
+
+	if (Batched)
+	{
+		//One term at a time over every machine, four machines per compare. Columns of machines that did not write this frame hold stale
+		//values, their results are never read.
+		FMemory::Memzero(PassedTerms.GetData(), NumPadded * sizeof(uint64));
+		for (uint64 Terms = LivePredicateTerms; Terms != 0; Terms &= Terms - 1)
+		{
+			const int32 Term = FMath::CountTrailingZeros64(Terms);
+			const FStatePredicateTerm& Predicate = PredicateTerms[Term];
+			const float* Column = PredicateInputs[static_cast<uint8>(Predicate.Input)].GetData();
+			const VectorRegister4Float Threshold = VectorSetFloat1(Predicate.Threshold);
+			//Below is the complement of AtLeast, so both are one compare.
+			const int32 Invert = Predicate.Comparison == EStatePredicateComparison::Below ? 0xF : 0;
+			const uint64 TermBit = uint64(1) << Term;
+			const VectorRegister4Int TermBits = MakeVectorRegisterInt(static_cast<int32>(TermBit), static_cast<int32>(TermBit >> 32),
+				static_cast<int32>(TermBit), static_cast<int32>(TermBit >> 32));
+
+			for (int32 Index = 0; Index < NumPadded; Index += 4)
+			{
+				const int32 Held = VectorMaskBits(VectorCompareGE(VectorLoad(Column + Index), Threshold)) ^ Invert;
+				const uint64* Spread = LaneSpread.Masks[Held];
+				uint64* Passed = &PassedTerms[Index];
+				VectorIntStore(VectorIntOr(VectorIntLoad(Passed), VectorIntAnd(VectorIntLoad(Spread), TermBits)), Passed);
+				VectorIntStore(VectorIntOr(VectorIntLoad(Passed + 2), VectorIntAnd(VectorIntLoad(Spread + 2), TermBits)), Passed + 2);
+			}
+		}
+	}
+
+	for (int32 Index = 0; Index < Num; ++Index)
+	{
+		if (!IsDetectionDue(Index) || !HasPredicates(Index)) continue;
+
+		uint64 Candidates = 0;
+		if (!Batched || ScalarPredicateFlags[Index])
+		{
+			Candidates = Machines[Index]->EvaluatePredicates();
+		}
+		else
+		{
+			const uint64* TermMasks = &PredicateTermMasks[Index * NumCharacterStates];
+			for (uint64 States = PredicateStates[Index] & TransitionMasks[Index]; States != 0; States &= States - 1)
+			{
+				const int32 State = FMath::CountTrailingZeros64(States);
+				if ((PassedTerms[Index] & TermMasks[State]) == TermMasks[State]) Candidates |= uint64(1) << State;
+			}
+		}
+
+		//Parallel machines already have their queried candidates in the slot.
+		CandidateMasks[Index] = (ParallelDetectionFlags[Index] ? CandidateMasks[Index] : 0) | Candidates;
+	}
+}
+
+void UCharacterStateMachineSubsystem::SyncPredicates(UCharacterStateMachine& Machine)
+{
+	const int32 Index = Machine.BatchIndex;
+	if (!Machines.IsValidIndex(Index) || Machines[Index] != &Machine) return;
+
+	NumPredicateMachines -= HasPredicates(Index) ? 1 : 0;
+	PredicateStates[Index] = 0;
+	ScalarPredicateFlags[Index] = false;
+	ReleasePredicateTerms(HeldPredicateTerms[Index]);
+	HeldPredicateTerms[Index] = 0;
+	uint64* TermMasks = &PredicateTermMasks[Index * NumCharacterStates];
+	FMemory::Memzero(TermMasks, NumCharacterStates * sizeof(uint64));
+
+	for (const FMechanicStateData& Mechanic : Machine.GetMechanics())
+	{
+		const FStateMechanicSettings& Settings = Mechanic.Component->GetSettings();
+		if (!Settings.UsesPredicate()) continue;
+
+		uint64 TermMask = 0;
+		for (int32 Term = 0; Term < Settings.NumPredicateTerms; ++Term)
+		{
+			const int32 TermIndex = AcquirePredicateTerm(Settings.PredicateTerms[Term], HeldPredicateTerms[Index]);
+			if (TermIndex == INDEX_NONE)
+			{
+				ScalarPredicateFlags[Index] = true;
+				break;
+			}
+			TermMask |= uint64(1) << TermIndex;
+		}
+		TermMasks[static_cast<uint8>(Mechanic.State)] = TermMask;
+		PredicateStates[Index] |= StateMachineCore::StateBit(Mechanic.State);
+	}
+
+	if (ScalarPredicateFlags[Index])
+	{
+		UE_LOG(LogTemp, Warning, TEXT("%s: more than %d distinct predicate terms in the world, its predicates are evaluated one machine at a time"),
+			*Machine.GetOwner()->GetName(), MaxPredicateTerms);
+		PredicateStates[Index] = 0;
+		ReleasePredicateTerms(HeldPredicateTerms[Index]);
+		HeldPredicateTerms[Index] = 0;
+	}
+	NumPredicateMachines += HasPredicates(Index) ? 1 : 0;
+}
+
+int32 UCharacterStateMachineSubsystem::AcquirePredicateTerm(const FStatePredicateTerm& Term, uint64& HeldTerms)
+{
+	int32 FreeIndex = INDEX_NONE;
+	for (int32 Index = 0; Index < PredicateTerms.Num(); ++Index)
+	{
+		if (PredicateTermRefs[Index] == 0)
+		{
+			if (FreeIndex == INDEX_NONE) FreeIndex = Index;
+			continue;
+		}
+		if (!(PredicateTerms[Index] == Term)) continue;
+
+		//A machine holds one reference per term, however many of its mechanics test it.
+		if ((HeldTerms & uint64(1) << Index) == 0) PredicateTermRefs[Index]++;
+		HeldTerms |= uint64(1) << Index;
+		return Index;
+	}
+
+	if (FreeIndex == INDEX_NONE)
+	{
+		if (PredicateTerms.Num() >= MaxPredicateTerms) return INDEX_NONE;
+		FreeIndex = PredicateTerms.Add(Term);
+		PredicateTermRefs.Add(0);
+	}
+	PredicateTerms[FreeIndex] = Term;
+	PredicateTermRefs[FreeIndex] = 1;
+	LivePredicateTerms |= uint64(1) << FreeIndex;
+	HeldTerms |= uint64(1) << FreeIndex;
+	return FreeIndex;
+}
+
+void UCharacterStateMachineSubsystem::ReleasePredicateTerms(const uint64 HeldTerms)
+{
+	for (uint64 Terms = HeldTerms; Terms != 0; Terms &= Terms - 1)
+	{
+		const int32 Term = FMath::CountTrailingZeros64(Terms);
+		if (--PredicateTermRefs[Term] == 0) LivePredicateTerms &= ~(uint64(1) << Term);
+	}
+}
+
+TStatId UCharacterStateMachineSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UCharacterStateMachineSubsystem, STATGROUP_Tickables);
+}
+
+bool UCharacterStateMachineSubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+void UCharacterStateMachineSubsystem::RegisterMachine(UCharacterStateMachine& Machine)
+{
+	if (Machine.IsBatched()) return;
+
+	Machine.BatchIndex = Machines.Add(&Machine);
+	Machine.BatchSubsystem = this;
+	CurrentStates.Add(Machine.GetCurrentEnumState());
+	RunUpdateFlags.Add(false);
+	TransitionMasks.Add(0);
+	ParallelDetectionFlags.Add(Machine.UsesParallelDetection());
+	FixedStepFlags.Add(Machine.UsesFixedTimestep());
+	NumParallelMachines += Machine.UsesParallelDetection() ? 1 : 0;
+	CandidateMasks.Add(0);
+	UpdateIntervals.Add(1);
+	LODPhases.Add(0);
+	DueFlags.Add(false);
+	PredicateStates.Add(0);
+	PredicateTermMasks.AddZeroed(NumCharacterStates);
+	ScalarPredicateFlags.Add(false);
+	HeldPredicateTerms.Add(0);
+	for (TArray<float>& Column : PredicateInputs)
+	{
+		Column.SetNumZeroed(Align(Machines.Num(), 4));
+	}
+	PassedTerms.SetNumZeroed(Align(Machines.Num(), 4));
+	Machine.SyncBatchedState();
+	SyncPredicates(Machine);
+}
+
+void UCharacterStateMachineSubsystem::UnregisterMachine(UCharacterStateMachine& Machine)
+{
+	const int32 Index = Machine.BatchIndex;
+	if (!Machines.IsValidIndex(Index) || Machines[Index] != &Machine) return;
+
+	NumParallelMachines -= ParallelDetectionFlags[Index] ? 1 : 0;
+	NumPredicateMachines -= HasPredicates(Index) ? 1 : 0;
+	ReleasePredicateTerms(HeldPredicateTerms[Index]);
+	HeldPredicateTerms[Index] = 0;
+
+	if (bTicking)
+	{
+		//Leaves nothing in the slot for the remaining passes to run, Tick removes it at the end.
+		Machines[Index] = nullptr;
+		RunUpdateFlags[Index] = false;
+		TransitionMasks[Index] = 0;
+		ParallelDetectionFlags[Index] = false;
+		DueFlags[Index] = false;
+		PredicateStates[Index] = 0;
+		ScalarPredicateFlags[Index] = false;
+		NumRemovedSlots++;
+		for (UCharacterStateMachine*& Pending : PendingCommits)
+		{
+			if (Pending == &Machine) Pending = nullptr;
+		}
+		for (UCharacterStateMachine*& Pending : PendingTraceResolves)
+		{
+			if (Pending == &Machine) Pending = nullptr;
+		}
+	}
+	else
+	{
+		RemoveSlot(Index);
+		PendingCommits.Remove(&Machine);
+		PendingTraceResolves.Remove(&Machine);
+	}
+
+	Machine.BatchIndex = INDEX_NONE;
+	Machine.BatchSubsystem = nullptr;
+}
+
+void UCharacterStateMachineSubsystem::RemoveSlot(const int32 Index)
+{
+	//Swap removal keeps the arrays dense.
+	Machines.RemoveAtSwap(Index);
+	CurrentStates.RemoveAtSwap(Index);
+	RunUpdateFlags.RemoveAtSwap(Index);
+	TransitionMasks.RemoveAtSwap(Index);
+	ParallelDetectionFlags.RemoveAtSwap(Index);
+	FixedStepFlags.RemoveAtSwap(Index);
+	CandidateMasks.RemoveAtSwap(Index);
+	UpdateIntervals.RemoveAtSwap(Index);
+	LODPhases.RemoveAtSwap(Index);
+	DueFlags.RemoveAtSwap(Index);
+	PredicateStates.RemoveAtSwap(Index);
+	ScalarPredicateFlags.RemoveAtSwap(Index);
+	HeldPredicateTerms.RemoveAtSwap(Index);
+
+	//Term masks are NumCharacterStates wide per machine, the last block moves into the freed one.
+	const int32 LastBlock = Machines.Num() * NumCharacterStates;
+	if (Index < Machines.Num())
+	{
+		FMemory::Memcpy(&PredicateTermMasks[Index * NumCharacterStates], &PredicateTermMasks[LastBlock], NumCharacterStates * sizeof(uint64));
+	}
+	PredicateTermMasks.SetNum(LastBlock);
+	//The gathered inputs are refreshed every frame before they are read, only the padded length has to follow.
+	for (TArray<float>& Column : PredicateInputs)
+	{
+		Column.SetNum(Align(Machines.Num(), 4));
+	}
+	PassedTerms.SetNum(Align(Machines.Num(), 4));
+
+	if (Machines.IsValidIndex(Index))
+	{
+		Machines[Index]->BatchIndex = Index;
+	}
+}
+
+namespace
+{
+	//Written in front of each machine's snapshot in a bulk buffer. The owner is what tells machines apart: the same number of
+	//machines registered in another order, or others swapped in, have snapshots of the same size.
+	struct FSnapshotBlockHeader
+	{
+		uint32 OwnerId;
+		uint32 Size;
+	};
+
+	//The owner's object index, unique among live objects, so a machine keeps it for as long as its owner exists.
+	uint32 GetSnapshotOwnerId(const UCharacterStateMachine& Machine)
+	{
+		const AActor* Owner = Machine.GetOwner();
+		return Owner != nullptr ? Owner->GetUniqueID() : Machine.GetUniqueID();
+	}
+}
+
+int32 UCharacterStateMachineSubsystem::GetSnapshotSize() const
+{
+	int32 Size = 0;
+	for (const UCharacterStateMachine* Machine : Machines)
+	{
+		Size += sizeof(FSnapshotBlockHeader) + (Machine != nullptr ? Machine->GetSnapshotSize() : 0);
+	}
+	return Size;
+}
+
+void UCharacterStateMachineSubsystem::SaveSnapshots(TArray<uint8>& Buffer) const
+{
+	Buffer.SetNumUninitialized(GetSnapshotSize());
+
+	uint8* Write = Buffer.GetData();
+	for (const UCharacterStateMachine* Machine : Machines)
+	{
+		//Slots unregistered during a tick stay empty until it ends, they get an empty block.
+		const FSnapshotBlockHeader Block = Machine != nullptr
+			? FSnapshotBlockHeader{ GetSnapshotOwnerId(*Machine), static_cast<uint32>(Machine->GetSnapshotSize()) }
+			: FSnapshotBlockHeader{ 0, 0 };
+		FMemory::Memcpy(Write, &Block, sizeof(Block));
+		if (Machine != nullptr) Machine->SaveSnapshot(Write + sizeof(Block));
+		Write += sizeof(Block) + Block.Size;
+	}
+}
+
+bool UCharacterStateMachineSubsystem::RestoreSnapshots(const TArray<uint8>& Buffer)
+{
+	if (Buffer.Num() != GetSnapshotSize()) return false;
+
+	//Checked in full before anything is restored, so a mismatch never leaves the machines half rolled back.
+	const uint8* Read = Buffer.GetData();
+	for (const UCharacterStateMachine* Machine : Machines)
+	{
+		FSnapshotBlockHeader Block;
+		FMemory::Memcpy(&Block, Read, sizeof(Block));
+		const uint32 OwnerId = Machine != nullptr ? GetSnapshotOwnerId(*Machine) : 0;
+		const uint32 Size = Machine != nullptr ? static_cast<uint32>(Machine->GetSnapshotSize()) : 0;
+		if (Block.OwnerId != OwnerId || Block.Size != Size) return false;
+		Read += sizeof(Block) + Block.Size;
+	}
+
+	Read = Buffer.GetData();
+	for (UCharacterStateMachine* Machine : Machines)
+	{
+		if (Machine == nullptr)
+		{
+			Read += sizeof(FSnapshotBlockHeader);
+			continue;
+		}
+		Machine->RestoreSnapshot(Read + sizeof(FSnapshotBlockHeader));
+		Read += sizeof(FSnapshotBlockHeader) + Machine->GetSnapshotSize();
+	}
+	return true;
+}
+
+void UCharacterStateMachineSubsystem::EncodeSnapshotDelta(const TArray<uint8>& Previous, const TArray<uint8>& Current, TArray<uint8>& OutDelta)
+{
+	check(Previous.Num() == Current.Num());
+
+	OutDelta.SetNumUninitialized(StateMachineCore::GetMaxDeltaSize(Current.Num()), false);
+	const std::size_t Written = StateMachineCore::EncodeDelta(Previous.GetData(), Current.GetData(), Current.Num(), OutDelta.GetData());
+	OutDelta.SetNumUninitialized(static_cast<int32>(Written), false);
+}
+
+bool UCharacterStateMachineSubsystem::DecodeSnapshotDelta(const TArray<uint8>& Previous, const TArray<uint8>& Delta, TArray<uint8>& OutCurrent)
+{
+	OutCurrent.SetNumUninitialized(Previous.Num(), false);
+	return StateMachineCore::DecodeDelta(Previous.GetData(), Delta.GetData(), Delta.Num(), Previous.Num(), OutCurrent.GetData());
+}
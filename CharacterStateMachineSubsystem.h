@@ -0,0 +1,155 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "CharacterStateMachine.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "CharacterStateMachineSubsystem.generated.h"
+
+//World level manager for state machines that have UseBatchedUpdate on. Instead of every owner calling UpdateStateMachine and
+//DetectStates on its own component, the hot state of every registered machine is kept in contiguous arrays and all of them
+//are updated and detected in one pass per frame. Machines that have nothing to update or detect are skipped without touching them.
+//Machines with UseParallelDetection run their detection in two phases, a read-only query phase spread over worker threads and
+//a commit phase on the game thread. Detection predicates are evaluated in between, together four machines per vector compare once
+//enough machines have them, one machine at a time below that.
+UCLASS()
+class CHASING_5SD073_API UCharacterStateMachineSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+	virtual bool IsTickable() const override { return !Machines.IsEmpty(); }
+
+	void RegisterMachine(UCharacterStateMachine& Machine);
+	void UnregisterMachine(UCharacterStateMachine& Machine);
+
+	//Called by the machine whenever its hot state changes.
+	FORCEINLINE void SyncMachine(const int32 Index, const ECharacterState State, const bool bRunUpdate, const uint64 DetectableMask,
+		const uint8 UpdateInterval, const uint8 LODPhase)
+	{
+		CurrentStates[Index] = State;
+		RunUpdateFlags[Index] = bRunUpdate;
+		TransitionMasks[Index] = DetectableMask;
+		UpdateIntervals[Index] = UpdateInterval;
+		LODPhases[Index] = LODPhase;
+	}
+
+	//Called by the machine after setup, when the detection predicates of its mechanics may have changed.
+	void SyncPredicates(UCharacterStateMachine& Machine);
+
+	//Adds the machine to this frame's commit pass. Called on the first RequestState since its last commit.
+	void MarkPendingCommit(UCharacterStateMachine& Machine) { PendingCommits.Add(&Machine); }
+
+	//Has the machine read back its async traces at the start of next frame's tick, whether the LOD schedule has it due or not.
+	void MarkPendingTraceResolve(UCharacterStateMachine& Machine) { PendingTraceResolves.Add(&Machine); }
+
+	int32 GetNumMachines() const { return Machines.Num(); }
+
+	//Bulk rollback for every registered machine. The buffer holds each machine's snapshot back to back in registration order, each
+	//tagged with its owner, so it only fits while the same machines stay registered in the same order. Saving reuses the buffer's allocation.
+	int32 GetSnapshotSize() const;
+	void SaveSnapshots(TArray<uint8>& Buffer) const;
+	//Returns false, leaving every machine alone, if the buffer was saved with other machines or in another order.
+	bool RestoreSnapshots(const TArray<uint8>& Buffer);
+
+	//Delta encoding of bulk snapshots, see StateMachineCore::EncodeDelta. Frames that barely change encode to a few bytes.
+	static void EncodeSnapshotDelta(const TArray<uint8>& Previous, const TArray<uint8>& Current, TArray<uint8>& OutDelta);
+	static bool DecodeSnapshotDelta(const TArray<uint8>& Previous, const TArray<uint8>& Delta, TArray<uint8>& OutCurrent);
+
+	//Detection counters of every batched machine summed over the last frame.
+	const FStateDetectionStats& GetFrameDetectionStats() const { return FrameDetectionStats; }
+
+protected:
+	virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+
+private:
+	//Whether the machine has anything to detect this frame. Fixed timestep machines detect in their own steps.
+	FORCEINLINE bool IsDetectionDue(const int32 Index) const { return DueFlags[Index] && !FixedStepFlags[Index] && TransitionMasks[Index] != 0; }
+	FORCEINLINE bool HasPredicates(const int32 Index) const { return PredicateStates[Index] != 0 || ScalarPredicateFlags[Index]; }
+
+	//Batched, tests each term against the input columns the machines wrote while preparing detection, four machines per compare,
+	//and ORs the states whose terms all held into CandidateMasks. Otherwise each machine evaluates its own predicates.
+	void EvaluatePredicates(const bool Batched);
+
+	//Term slots are refcounted by the machines using them. Acquire returns INDEX_NONE when all MaxPredicateTerms are in use.
+	int32 AcquirePredicateTerm(const FStatePredicateTerm& Term, uint64& HeldTerms);
+	void ReleasePredicateTerms(const uint64 HeldTerms);
+
+	//Swap removes the slot, the machine moved into it gets its index patched.
+	void RemoveSlot(const int32 Index);
+
+	//Set for the whole of Tick. Machines unregistered meanwhile only have their slot nulled and made inert, the slots are removed
+	//once the passes are done, so no pass sees its arrays shift under it.
+	bool bTicking = false;
+	int32 NumRemovedSlots = 0;
+
+	//All arrays below are parallel, indexed by UCharacterStateMachine::BatchIndex. A null machine is a slot waiting for removal.
+	UPROPERTY(Transient)
+	TArray<UCharacterStateMachine*> Machines;
+
+	TArray<ECharacterState> CurrentStates;
+	TArray<bool> RunUpdateFlags;
+
+	//States each machine could enter from its current state. Zero means there is nothing to detect.
+	TArray<uint64> TransitionMasks;
+
+	TArray<bool> ParallelDetectionFlags;
+
+	//Machines in fixed timestep mode detect after each of their steps in the update pass, the detection pass skips them.
+	TArray<bool> FixedStepFlags;
+
+	//LOD schedule of each machine, see UCharacterStateMachine::IsDueOnFrame. Kept here so skipped machines are never dereferenced.
+	TArray<uint8> UpdateIntervals;
+	TArray<uint8> LODPhases;
+
+	//Whether each machine is due this frame, worked out once at the start of the tick.
+	TArray<bool> DueFlags;
+
+	//Output of the parallel query phase, consumed by the commit phase in the same frame.
+	TArray<uint64> CandidateMasks;
+
+	int32 NumParallelMachines = 0;
+
+	//Every distinct predicate term of the registered machines, so machines sharing a mechanic setup test each term once. A slot
+	//is free once no machine references it, and reused by the next new term.
+	TArray<FStatePredicateTerm> PredicateTerms;
+	TArray<int32> PredicateTermRefs;
+	uint64 LivePredicateTerms = 0;
+	static constexpr int32 MaxPredicateTerms = 64;
+
+	//Below this many predicate machines, the per term loops cost more than the vector compares save, and each machine evaluates
+	//its own predicates. Measured with the standalone benchmark.
+	static constexpr int32 MinBatchedPredicateMachines = 16;
+
+	//Predicate inputs of every machine, one column per EStatePredicateInput, padded to a multiple of four machines. Machines
+	//write their own slot, see UCharacterStateMachine::GatherPredicateInputs, so nothing is copied into them.
+	TArray<float> PredicateInputs[NumPredicateInputs];
+	//Mask of PredicateTerms that held for each machine this frame, padded like the columns.
+	TArray<uint64> PassedTerms;
+
+	//States of each machine that have a predicate, and for each of them the mask of PredicateTerms that all have to hold,
+	//NumCharacterStates entries per machine.
+	TArray<uint64> PredicateStates;
+	TArray<uint64> PredicateTermMasks;
+
+	//Machines whose terms did not fit in PredicateTerms. They evaluate their own predicates, one machine at a time.
+	TArray<bool> ScalarPredicateFlags;
+
+	//Mask of PredicateTerms each machine holds a reference to.
+	TArray<uint64> HeldPredicateTerms;
+
+	int32 NumPredicateMachines = 0;
+
+	//Machines with queued transition requests, committed once after the detection pass. Null once unregistered mid-tick.
+	UPROPERTY(Transient)
+	TArray<UCharacterStateMachine*> PendingCommits;
+
+	//Machines that submitted async traces last frame. Null once unregistered mid-tick, like PendingCommits.
+	UPROPERTY(Transient)
+	TArray<UCharacterStateMachine*> PendingTraceResolves;
+
+	FStateDetectionStats FrameDetectionStats;
+};
@@ -0,0 +1,548 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+//Benchmarks of the engine-free core, built by CMakeLists.txt. UnrealBuildTool defines UBT_COMPILED_PLATFORM for everything it
+//builds, so inside the Unreal module this file is empty.
+//	StateMachineCoreBenchmark          full run, 1, 1k and 100k characters
+//	StateMachineCoreBenchmark --quick  a few rounds of each, what ctest runs
+//The characters mirror ECharacterState, five states on virtual calls like the components, so the numbers are of the core itself
+//and not of the mechanics behind it. The predicate section mirrors the detection predicates of UCharacterStateMachineSubsystem,
+//which need the engine, with the same layout and the same SSE compares VectorCompareGE and VectorMaskBits compile to.
+#ifndef UBT_COMPILED_PLATFORM
+
+#include "StateMachineCore.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace StateMachineCore;
+
+//Every heap allocation of the process goes through here, so memory per machine is measured, not added up from sizeof.
+namespace
+{
+	std::size_t AllocatedBytes = 0;
+}
+
+//GCC sees free on memory that came from new once these are inlined, and does not know they are the replacements of each other.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(std::size_t Size)
+{
+	AllocatedBytes += Size;
+	if (void* Memory = std::malloc(Size)) return Memory;
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t Size)
+{
+	return operator new(Size);
+}
+
+void operator delete(void* Memory) noexcept { std::free(Memory); }
+void operator delete(void* Memory, std::size_t) noexcept { std::free(Memory); }
+void operator delete[](void* Memory) noexcept { std::free(Memory); }
+void operator delete[](void* Memory, std::size_t) noexcept { std::free(Memory); }
+
+namespace
+{
+	enum class EBenchState : uint8_t { DefaultState, Sliding, WallClimbing, WallRunning, AirDashing, Count };
+	constexpr int NumBenchStates = static_cast<int>(EBenchState::Count);
+
+	struct FBenchCharacter;
+
+	//Stands in for UStateComponentBase, every call is virtual.
+	class FBenchState
+	{
+	public:
+		virtual ~FBenchState() = default;
+
+		virtual bool OnSetStateConditionCheck(FBenchCharacter&) { return true; }
+		virtual void OnEnterState(FBenchCharacter&) { NumEnters++; }
+		virtual void OnUpdateState(FBenchCharacter&) {}
+		virtual void OnUpdateState(FBenchCharacter&, float) {}
+		virtual void OnExitState(FBenchCharacter&) {}
+		//Same shape as OverrideDetectState, a threshold on what the character reports.
+		virtual bool Detect(const FBenchCharacter& Character) const;
+
+		EBenchState Enum = EBenchState::DefaultState;
+		float Threshold = 0;
+		uint32_t NumEnters = 0;
+	};
+
+	using FBenchCore = TStateMachineCore<EBenchState, FBenchState, NumBenchStates>;
+	using FBenchDefinition = FBenchCore::FDefinition;
+
+	struct FBenchCharacter
+	{
+		FBenchCore Core;
+		FBenchState States[NumBenchStates];
+		//What the detectors read, one value per state so they switch at different times.
+		float Probes[NumBenchStates] = {};
+	};
+
+	bool FBenchState::Detect(const FBenchCharacter& Character) const
+	{
+		return Character.Probes[static_cast<int>(Enum)] > Threshold;
+	}
+
+	//Every state can be entered from DefaultState and goes back to it, like the mechanics in the example project.
+	FBenchDefinition MakeDefinition()
+	{
+		FBenchDefinition Definition;
+		for (int Index = 0; Index < NumBenchStates; ++Index)
+		{
+			const EBenchState Enum = static_cast<EBenchState>(Index);
+			Definition.BindState(Enum);
+			if (Enum == EBenchState::DefaultState) continue;
+			Definition.Table.Allow(EBenchState::DefaultState, Enum);
+			Definition.Table.Allow(Enum, EBenchState::DefaultState);
+		}
+		return Definition;
+	}
+
+	void SetupCharacter(FBenchCharacter& Character, const FBenchDefinition& Definition, const int Seed)
+	{
+		Character.Core.SetDefinition(Definition);
+		for (int Index = 0; Index < NumBenchStates; ++Index)
+		{
+			FBenchState& State = Character.States[Index];
+			State.Enum = static_cast<EBenchState>(Index);
+			State.Threshold = 0.5f;
+			Character.Core.BindState(State.Enum, &State);
+		}
+		Character.Core.SetState(EBenchState::DefaultState, Character);
+		Character.Probes[1 + Seed % (NumBenchStates - 1)] = 1;
+	}
+
+	using FClock = std::chrono::steady_clock;
+
+	double SecondsSince(const FClock::time_point Start)
+	{
+		return std::chrono::duration<double>(FClock::now() - Start).count();
+	}
+
+	//Everything the benchmarks compute ends up in here and is printed, so the optimizer cannot drop the work.
+	uint64_t Sink = 0;
+
+	struct FRunSettings
+	{
+		std::vector<int> CharacterCounts;
+		//Machine operations per character count, divided among the characters.
+		int64_t OperationsPerRun;
+	};
+
+	std::vector<std::unique_ptr<FBenchCharacter[]>> Pool;
+
+	FBenchCharacter* MakeCharacters(const int Count, const FBenchDefinition& Definition)
+	{
+		Pool.emplace_back(new FBenchCharacter[Count]);
+		FBenchCharacter* Characters = Pool.back().get();
+		for (int Index = 0; Index < Count; ++Index) SetupCharacter(Characters[Index], Definition, Index);
+		return Characters;
+	}
+
+	void FreeCharacters()
+	{
+		Pool.clear();
+	}
+
+	int64_t GetRounds(const FRunSettings& Settings, const int Count)
+	{
+		const int64_t Rounds = Settings.OperationsPerRun / Count;
+		return Rounds > 1 ? Rounds : 1;
+	}
+
+	//SetState back and forth between DefaultState and each character's other state, enter and exit included.
+	void RunSetStateBenchmark(const FRunSettings& Settings)
+	{
+		const FBenchDefinition Definition = MakeDefinition();
+		std::printf("\nSetState throughput\n%12s %14s %14s\n", "characters", "ns/SetState", "M SetState/s");
+		for (const int Count : Settings.CharacterCounts)
+		{
+			FBenchCharacter* Characters = MakeCharacters(Count, Definition);
+			const int64_t Rounds = GetRounds(Settings, Count);
+
+			const FClock::time_point Start = FClock::now();
+			for (int64_t Round = 0; Round < Rounds; ++Round)
+			{
+				for (int Index = 0; Index < Count; ++Index)
+				{
+					FBenchCharacter& Character = Characters[Index];
+					const EBenchState Next = (Round & 1) == 0 ? static_cast<EBenchState>(1 + Index % (NumBenchStates - 1)) : EBenchState::DefaultState;
+					Sink += static_cast<uint64_t>(Character.Core.SetState(Next, Character));
+				}
+			}
+			const double Seconds = SecondsSince(Start);
+
+			const double Operations = static_cast<double>(Rounds) * Count;
+			std::printf("%12d %14.2f %14.2f\n", Count, Seconds * 1e9 / Operations, Operations / Seconds / 1e6);
+			FreeCharacters();
+		}
+	}
+
+	//A full detection pass per character per round, every detector dirty. Half the rounds a detector fires and switches state,
+	//the other half every detector runs without one firing, the two costs the detection loop has.
+	void RunDetectionBenchmark(const FRunSettings& Settings)
+	{
+		const FBenchDefinition Definition = MakeDefinition();
+		std::printf("\nDetection pass\n%12s %14s %14s\n", "characters", "ns/pass", "detectors/pass");
+		for (const int Count : Settings.CharacterCounts)
+		{
+			FBenchCharacter* Characters = MakeCharacters(Count, Definition);
+			const int64_t Rounds = GetRounds(Settings, Count);
+			uint64_t Evaluated = 0;
+
+			const FClock::time_point Start = FClock::now();
+			for (int64_t Round = 0; Round < Rounds; ++Round)
+			{
+				for (int Index = 0; Index < Count; ++Index)
+				{
+					FBenchCharacter& Character = Characters[Index];
+					if (Character.Core.GetCurrentEnumState() != EBenchState::DefaultState)
+					{
+						Character.Core.SetState(EBenchState::DefaultState, Character);
+					}
+					Character.Probes[1 + Index % (NumBenchStates - 1)] = (Round & 1) == 0 ? 1.0f : 0.0f;
+
+					Character.Core.Detect(~uint64_t(0), [&Character](const EBenchState Enum, FBenchState& State)
+					{
+						if (State.Detect(Character)) Character.Core.SetState(Enum, Character);
+						return false;
+					});
+					Evaluated += Character.Core.GetDetectionStats().Evaluated;
+				}
+			}
+			const double Seconds = SecondsSince(Start);
+
+			const double Passes = static_cast<double>(Rounds) * Count;
+			std::printf("%12d %14.2f %14.2f\n", Count, Seconds * 1e9 / Passes, Evaluated / Passes);
+			Sink += Evaluated;
+			FreeCharacters();
+		}
+	}
+
+	//What TranslateEnumToState was before the lookup table, a scan over the mechanics list copying each entry.
+	struct FMechanicStateData
+	{
+		uint8_t State;
+		FBenchState* Component;
+	};
+
+	FBenchState* TranslateByScan(const std::vector<FMechanicStateData>& MechanicsList, const uint8_t Enum)
+	{
+		for (const FMechanicStateData HierarchyItem : MechanicsList)
+		{
+			if (HierarchyItem.State == Enum) return HierarchyItem.Component;
+		}
+		return nullptr;
+	}
+
+	//Old scan against the enum-indexed table TStateMachineCore::Translate reads, for a machine of NumStates states looked up in
+	//random order. The table is a plain array here, the core's transition table stops at 64 states.
+	template <int NumStates>
+	void RunLookupCase(const FRunSettings& Settings)
+	{
+		std::vector<FBenchState> Components(NumStates);
+		std::vector<FMechanicStateData> MechanicsList;
+		FBenchState* Lookup[NumStates] = {};
+		for (int Index = 0; Index < NumStates; ++Index)
+		{
+			MechanicsList.push_back({ static_cast<uint8_t>(Index), &Components[Index] });
+			Lookup[Index] = &Components[Index];
+		}
+
+		std::vector<uint8_t> Queries(4096);
+		uint32_t Random = 12345;
+		for (uint8_t& Query : Queries)
+		{
+			Random = Random * 1664525u + 1013904223u;
+			Query = static_cast<uint8_t>((Random >> 16) % NumStates);
+		}
+
+		const int64_t Rounds = Settings.OperationsPerRun / static_cast<int64_t>(Queries.size()) + 1;
+		const double Lookups = static_cast<double>(Rounds) * Queries.size();
+
+		uintptr_t Found = 0;
+		FClock::time_point Start = FClock::now();
+		for (int64_t Round = 0; Round < Rounds; ++Round)
+		{
+			for (const uint8_t Query : Queries) Found ^= reinterpret_cast<uintptr_t>(TranslateByScan(MechanicsList, Query));
+		}
+		const double ScanSeconds = SecondsSince(Start);
+
+		Start = FClock::now();
+		for (int64_t Round = 0; Round < Rounds; ++Round)
+		{
+			for (const uint8_t Query : Queries) Found ^= reinterpret_cast<uintptr_t>(Lookup[Query]);
+		}
+		const double TableSeconds = SecondsSince(Start);
+
+		Sink += Found;
+		std::printf("%12d %14.2f %14.2f %10.1fx\n", NumStates, ScanSeconds * 1e9 / Lookups, TableSeconds * 1e9 / Lookups, ScanSeconds / TableSeconds);
+	}
+
+	void RunLookupBenchmark(const FRunSettings& Settings)
+	{
+		std::printf("\nTranslateEnumToState, scan against table\n%12s %14s %14s %11s\n", "states", "scan ns", "table ns", "speedup");
+		RunLookupCase<5>(Settings);
+		RunLookupCase<32>(Settings);
+		RunLookupCase<128>(Settings);
+	}
+
+	//Same shape as FStatePredicateTerm and FStateMechanicSettings, over the eight EStatePredicateInput values.
+	constexpr int NumPredicateInputs = 8;
+	constexpr int MaxPredicateTerms = 4;
+
+	struct FPredicateTerm
+	{
+		uint8_t Input;
+		bool Below;
+		float Threshold;
+
+		bool Evaluate(const float* Inputs) const { return (Inputs[Input] >= Threshold) != Below; }
+	};
+
+	struct FPredicateSettings
+	{
+		int NumTerms = 0;
+		FPredicateTerm Terms[MaxPredicateTerms];
+
+		bool Evaluate(const float* Inputs) const
+		{
+			for (int Term = 0; Term < NumTerms; ++Term)
+			{
+				if (!Terms[Term].Evaluate(Inputs)) return false;
+			}
+			return true;
+		}
+	};
+
+	//Threshold tests like the example mechanics': slide when fast on ground, wall climb and wall run off the ground, air dash
+	//while a dash is left. Inputs are HorizontalSpeed, VerticalSpeed, Grounded, AirTime, MovementInput, TimeInState, Custom0 and 1.
+	std::vector<FPredicateSettings> MakePredicateSettings()
+	{
+		std::vector<FPredicateSettings> Settings(NumBenchStates);
+		Settings[1] = { 2, { { 0, false, 600 }, { 2, false, 0.5f } } };
+		Settings[2] = { 3, { { 2, true, 0.5f }, { 1, false, 0 }, { 4, false, 0.5f } } };
+		Settings[3] = { 3, { { 2, true, 0.5f }, { 0, false, 400 }, { 3, false, 0.1f } } };
+		Settings[4] = { 2, { { 2, true, 0.5f }, { 6, false, 1 } } };
+		return Settings;
+	}
+
+	//Stands in for a mechanic's own OverrideDetectState doing the same tests, one virtual call per mechanic.
+	class FPredicateDetector
+	{
+	public:
+		virtual ~FPredicateDetector() = default;
+		virtual bool Detect(const float* Inputs) const { return Settings->Evaluate(Inputs); }
+
+		const FPredicateSettings* Settings = nullptr;
+	};
+
+	//Per character: virtual detectors, the scalar predicate loop of UCharacterStateMachine::EvaluatePredicates, and the subsystem's
+	//batch, which tests each distinct term against the input columns four characters per compare and then checks each state's
+	//term mask. Characters write their inputs straight into the columns the way machines do while preparing detection, so like
+	//the per character inputs they are not part of the timing. Every pass finds the candidates of all four non-default states.
+	//The subsystem only batches from MinBatchedPredicateMachines, below that the per term loops cost more than they save.
+	void RunPredicateBenchmark(const FRunSettings& Settings)
+	{
+		const std::vector<FPredicateSettings> PredicateSettings = MakePredicateSettings();
+
+		//The lane spread table of the subsystem, each compare mask bit as a full 64 bit lane.
+		alignas(16) uint64_t LaneSpread[16][4];
+		for (int Held = 0; Held < 16; ++Held)
+		{
+			for (int Lane = 0; Lane < 4; ++Lane) LaneSpread[Held][Lane] = (Held >> Lane) & 1 ? ~uint64_t(0) : 0;
+		}
+
+		//What SyncPredicates builds, the distinct terms of the world and the mask of them each state needs.
+		std::vector<FPredicateTerm> Terms;
+		uint64_t StateTermMasks[NumBenchStates] = {};
+		for (int State = 1; State < NumBenchStates; ++State)
+		{
+			for (int Term = 0; Term < PredicateSettings[State].NumTerms; ++Term)
+			{
+				const FPredicateTerm& Predicate = PredicateSettings[State].Terms[Term];
+				size_t Index = 0;
+				while (Index < Terms.size() && !(Terms[Index].Input == Predicate.Input && Terms[Index].Below == Predicate.Below
+					&& Terms[Index].Threshold == Predicate.Threshold)) ++Index;
+				if (Index == Terms.size()) Terms.push_back(Predicate);
+				StateTermMasks[State] |= uint64_t(1) << Index;
+			}
+		}
+
+		std::printf("\nDetection predicates, ns per character\n%12s %14s %14s %14s %10s\n", "characters", "virtual", "per character",
+			"batched", "speedup");
+		for (const int Count : Settings.CharacterCounts)
+		{
+			const int NumPadded = (Count + 3) & ~3;
+
+			//What each machine gathers, varied so every state is a candidate for some characters.
+			std::vector<float> CharacterInputs(static_cast<size_t>(Count) * NumPredicateInputs);
+			uint32_t Random = 777;
+			for (float& Input : CharacterInputs)
+			{
+				Random = Random * 1664525u + 1013904223u;
+				Input = static_cast<float>((Random >> 16) % 1000);
+			}
+			for (int Index = 0; Index < Count; ++Index) CharacterInputs[Index * NumPredicateInputs + 2] = static_cast<float>(Index & 1);
+
+			std::vector<FPredicateDetector> Detectors(static_cast<size_t>(Count) * NumBenchStates);
+			for (size_t Index = 0; Index < Detectors.size(); ++Index) Detectors[Index].Settings = &PredicateSettings[Index % NumBenchStates];
+
+			std::vector<float> Columns[NumPredicateInputs];
+			for (std::vector<float>& Column : Columns) Column.assign(NumPadded, 0);
+			for (int Index = 0; Index < Count; ++Index)
+			{
+				for (int Input = 0; Input < NumPredicateInputs; ++Input) Columns[Input][Index] = CharacterInputs[Index * NumPredicateInputs + Input];
+			}
+			std::vector<uint64_t> PassedTerms(NumPadded);
+			std::vector<uint64_t> TermMasks(static_cast<size_t>(Count) * NumBenchStates);
+			for (int Index = 0; Index < Count; ++Index) std::memcpy(&TermMasks[Index * NumBenchStates], StateTermMasks, sizeof(StateTermMasks));
+
+			const int64_t Rounds = GetRounds(Settings, Count);
+			const double Passes = static_cast<double>(Rounds) * Count;
+			uint64_t Candidates = 0;
+
+			FClock::time_point Start = FClock::now();
+			for (int64_t Round = 0; Round < Rounds; ++Round)
+			{
+				for (int Index = 0; Index < Count; ++Index)
+				{
+					const float* Inputs = &CharacterInputs[Index * NumPredicateInputs];
+					const FPredicateDetector* CharacterDetectors = &Detectors[Index * NumBenchStates];
+					for (int State = 1; State < NumBenchStates; ++State)
+					{
+						if (CharacterDetectors[State].Detect(Inputs)) Candidates += uint64_t(1) << State;
+					}
+				}
+			}
+			const double VirtualSeconds = SecondsSince(Start);
+
+			Start = FClock::now();
+			for (int64_t Round = 0; Round < Rounds; ++Round)
+			{
+				for (int Index = 0; Index < Count; ++Index)
+				{
+					const float* Inputs = &CharacterInputs[Index * NumPredicateInputs];
+					for (int State = 1; State < NumBenchStates; ++State)
+					{
+						if (PredicateSettings[State].Evaluate(Inputs)) Candidates += uint64_t(1) << State;
+					}
+				}
+			}
+			const double ScalarSeconds = SecondsSince(Start);
+
+			Start = FClock::now();
+			for (int64_t Round = 0; Round < Rounds; ++Round)
+			{
+				std::memset(PassedTerms.data(), 0, NumPadded * sizeof(uint64_t));
+				for (size_t Term = 0; Term < Terms.size(); ++Term)
+				{
+					const float* Column = Columns[Terms[Term].Input].data();
+					const int Invert = Terms[Term].Below ? 0xF : 0;
+					const uint64_t TermBit = uint64_t(1) << Term;
+#if defined(__SSE2__)
+					const __m128 Threshold = _mm_set1_ps(Terms[Term].Threshold);
+					const __m128i TermBits = _mm_set1_epi64x(static_cast<long long>(TermBit));
+#endif
+					for (int Index = 0; Index < NumPadded; Index += 4)
+					{
+#if defined(__SSE2__)
+						const int Held = _mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(Column + Index), Threshold)) ^ Invert;
+						const __m128i* Spread = reinterpret_cast<const __m128i*>(LaneSpread[Held]);
+						__m128i* Passed = reinterpret_cast<__m128i*>(&PassedTerms[Index]);
+						_mm_storeu_si128(Passed, _mm_or_si128(_mm_loadu_si128(Passed), _mm_and_si128(_mm_load_si128(Spread), TermBits)));
+						_mm_storeu_si128(Passed + 1, _mm_or_si128(_mm_loadu_si128(Passed + 1), _mm_and_si128(_mm_load_si128(Spread + 1), TermBits)));
+#else
+						int Held = Invert;
+						for (int Lane = 0; Lane < 4; ++Lane) Held ^= (Column[Index + Lane] >= Terms[Term].Threshold ? 1 : 0) << Lane;
+						for (int Lane = 0; Lane < 4; ++Lane) PassedTerms[Index + Lane] |= LaneSpread[Held][Lane] & TermBit;
+#endif
+					}
+				}
+
+				for (int Index = 0; Index < Count; ++Index)
+				{
+					const uint64_t* Masks = &TermMasks[Index * NumBenchStates];
+					for (int State = 1; State < NumBenchStates; ++State)
+					{
+						if ((PassedTerms[Index] & Masks[State]) == Masks[State]) Candidates += uint64_t(1) << State;
+					}
+				}
+			}
+			const double BatchedSeconds = SecondsSince(Start);
+
+			Sink += Candidates;
+			std::printf("%12d %14.2f %14.2f %14.2f %9.1fx\n", Count, VirtualSeconds * 1e9 / Passes, ScalarSeconds * 1e9 / Passes,
+				BatchedSeconds * 1e9 / Passes, ScalarSeconds / BatchedSeconds);
+		}
+	}
+
+	//A character the way machines were kept before definitions were shared, each with its own copy.
+	struct FUnsharedCharacter
+	{
+		FBenchDefinition Definition;
+		FBenchCharacter Character;
+	};
+
+	//Heap bytes per character, the machine with its states and probes, with one shared definition and with a copy each. The shared
+	//definition is counted once, spread over the characters.
+	void RunMemoryBenchmark(const FRunSettings& Settings)
+	{
+		std::printf("\nMemory per character\n%12s %14s %14s %14s\n", "characters", "shared", "copy each", "machine bytes");
+		for (const int Count : Settings.CharacterCounts)
+		{
+			std::size_t Before = AllocatedBytes;
+			std::unique_ptr<FBenchDefinition> Definition(new FBenchDefinition(MakeDefinition()));
+			MakeCharacters(Count, *Definition);
+			const double Shared = static_cast<double>(AllocatedBytes - Before) / Count;
+			FreeCharacters();
+			Definition.reset();
+
+			Before = AllocatedBytes;
+			std::unique_ptr<FUnsharedCharacter[]> Unshared(new FUnsharedCharacter[Count]);
+			for (int Index = 0; Index < Count; ++Index)
+			{
+				Unshared[Index].Definition = MakeDefinition();
+				SetupCharacter(Unshared[Index].Character, Unshared[Index].Definition, Index);
+			}
+			const double CopyEach = static_cast<double>(AllocatedBytes - Before) / Count;
+			Unshared.reset();
+
+			std::printf("%12d %14.1f %14.1f %14zu\n", Count, Shared, CopyEach, sizeof(FBenchCore));
+		}
+	}
+}
+
+int main(const int ArgumentCount, char** Arguments)
+{
+	const bool Quick = ArgumentCount > 1 && std::strcmp(Arguments[1], "--quick") == 0;
+
+	FRunSettings Settings;
+	Settings.CharacterCounts = { 1, 1000, 100000 };
+	Settings.OperationsPerRun = Quick ? 200000 : 20000000;
+
+	std::printf("State machine core benchmark%s\n", Quick ? " (quick)" : "");
+	RunSetStateBenchmark(Settings);
+	RunDetectionBenchmark(Settings);
+	//The predicate section also runs MinBatchedPredicateMachines, where batching starts, and a crowd of 500.
+	FRunSettings CrowdSettings = Settings;
+	CrowdSettings.CharacterCounts = { 1, 16, 500, 1000, 100000 };
+	RunPredicateBenchmark(CrowdSettings);
+	RunMemoryBenchmark(Settings);
+	RunLookupBenchmark(Settings);
+
+	std::printf("\n(checksum %llu)\n", static_cast<unsigned long long>(Sink));
+	return 0;
+}
+
+#endif
@@ -0,0 +1,353 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+//Tests of the engine-free core, built by CMakeLists.txt. UnrealBuildTool defines UBT_COMPILED_PLATFORM for everything it builds,
+//so inside the Unreal module this file is empty.
+#ifndef UBT_COMPILED_PLATFORM
+
+#include "StateMachineCore.h"
+#include "StateMachineSnapshot.h"
+#include "StaticStateMachine.h"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace StateMachineCore;
+
+namespace
+{
+	int NumFailures = 0;
+
+	void Check(const bool Condition, const char* Expression, const int Line)
+	{
+		if (Condition) return;
+		std::printf("FAILED line %d: %s\n", Line, Expression);
+		NumFailures++;
+	}
+
+#define CHECK(Expression) Check((Expression), #Expression, __LINE__)
+
+	enum class ETestState : uint8_t { Walk, Slide, Idle, Aim, AimFine, AimCoarse, Count };
+	constexpr int NumTestStates = static_cast<int>(ETestState::Count);
+
+	struct FTestContext
+	{
+		std::string Log;
+	};
+
+	//Logs +X on enter, -X on exit and uX on update.
+	struct FTestState
+	{
+		char Name = '?';
+		bool Condition = true;
+
+		bool OnSetStateConditionCheck(FTestContext&) { return Condition; }
+		void OnEnterState(FTestContext& Context) { Context.Log += '+'; Context.Log += Name; }
+		void OnUpdateState(FTestContext& Context) { Context.Log += 'u'; Context.Log += Name; }
+		void OnUpdateState(FTestContext& Context, float) { Context.Log += 's'; Context.Log += Name; }
+		void OnExitState(FTestContext& Context) { Context.Log += '-'; Context.Log += Name; }
+	};
+
+	using FTestCore = TStateMachineCore<ETestState, FTestState, NumTestStates>;
+	using FTestDefinition = FTestCore::FDefinition;
+
+	//Walk and Slide in region 0, Idle and Aim in an orthogonal region, AimFine and AimCoarse in a sub-state region of Aim.
+	struct FTestMachine
+	{
+		FTestDefinition Definition;
+		FTestCore Core;
+		FTestState States[NumTestStates];
+		FTestContext Context;
+
+		FTestMachine()
+		{
+			const char Names[] = "WSIAFC";
+			for (int Index = 0; Index < NumTestStates; ++Index) States[Index].Name = Names[Index];
+
+			Definition.BindState(ETestState::Walk);
+			Definition.BindState(ETestState::Slide);
+			const int Upper = Definition.AddRegion();
+			Definition.BindState(ETestState::Idle, Upper);
+			Definition.BindState(ETestState::Aim, Upper);
+			const int Aiming = Definition.AddRegion(ETestState::Aim);
+			Definition.BindState(ETestState::AimFine, Aiming);
+			Definition.BindState(ETestState::AimCoarse, Aiming);
+
+			Definition.Table.Allow(ETestState::Walk, ETestState::Slide);
+			Definition.Table.Allow(ETestState::Slide, ETestState::Walk);
+			Definition.Table.Allow(ETestState::Idle, ETestState::Aim);
+			Definition.Table.Allow(ETestState::Aim, ETestState::Idle);
+			Definition.Table.Allow(ETestState::AimFine, ETestState::AimCoarse);
+			Definition.SetGuards(ETestState::Aim, 0, StateBit(ETestState::Slide));
+
+			Core.SetDefinition(Definition);
+			for (int Index = 0; Index < NumTestStates; ++Index) Core.BindState(static_cast<ETestState>(Index), &States[Index]);
+		}
+
+		std::string TakeLog()
+		{
+			std::string Log = Context.Log;
+			Context.Log.clear();
+			return Log;
+		}
+	};
+
+	void TestTransitionTable()
+	{
+		TTransitionTable<ETestState, NumTestStates> Table;
+		Table.Allow(ETestState::Walk, ETestState::Slide);
+		CHECK(Table.CanTransition(ETestState::Walk, ETestState::Slide));
+		CHECK(!Table.CanTransition(ETestState::Slide, ETestState::Walk));
+		CHECK(Table.GetEnterableMask(ETestState::Walk) == StateBit(ETestState::Slide));
+
+		TTransitionTable<ETestState, NumTestStates> Copy = Table;
+		CHECK(Copy == Table);
+		Copy.Allow(ETestState::Slide, ETestState::Walk);
+		CHECK(!(Copy == Table));
+		Copy.Reset();
+		CHECK(Copy.GetEnterableMask(ETestState::Walk) == 0);
+
+		static_assert(TTransitionTable<ETestState, NumTestStates>::AllStatesMask == 0x3f, "");
+		static_assert(TTransitionTable<ETestState, 64>::AllStatesMask == ~uint64_t(0), "");
+	}
+
+	void TestRegionsAndGuards()
+	{
+		FTestMachine Machine;
+		FTestCore& Core = Machine.Core;
+
+		//The upper body region only starts once region 0 has a state.
+		CHECK(Core.SetState(ETestState::Aim, Machine.Context) == ESetStateResult::Blocked);
+		CHECK(Core.SetState(ETestState::Walk, Machine.Context) == ESetStateResult::Entered);
+		CHECK(Machine.TakeLog() == "+W+I");
+
+		CHECK(Core.SetState(ETestState::Slide, Machine.Context) == ESetStateResult::Entered);
+		CHECK(Core.SetState(ETestState::Aim, Machine.Context) == ESetStateResult::Blocked);
+		Core.SetState(ETestState::Walk, Machine.Context);
+		Machine.TakeLog();
+
+		//Entering Aim starts its sub-state region in its first state.
+		CHECK(Core.SetState(ETestState::Aim, Machine.Context) == ESetStateResult::Entered);
+		CHECK(Machine.TakeLog() == "-I+A+F");
+		CHECK(Core.GetActiveMask() == (StateBit(ETestState::Walk) | StateBit(ETestState::Aim) | StateBit(ETestState::AimFine)));
+
+		Core.Update(Machine.Context);
+		CHECK(Machine.TakeLog() == "uWuAuF");
+		Core.Step(Machine.Context, 0.1f);
+		CHECK(Machine.TakeLog() == "sWsAsF");
+
+		//Leaving Aim exits its sub-states first.
+		CHECK(Core.SetState(ETestState::Idle, Machine.Context) == ESetStateResult::Entered);
+		CHECK(Machine.TakeLog() == "-F-A+I");
+
+		CHECK(Core.SetState(ETestState::Walk, Machine.Context) == ESetStateResult::Disallowed);
+		CHECK(Core.CheckRequest(ETestState::Walk) == ESetStateResult::Disallowed);
+		CHECK(Core.CheckRequest(ETestState::Slide) == ESetStateResult::Entered);
+		Machine.States[static_cast<int>(ETestState::Slide)].Condition = false;
+		CHECK(Core.SetState(ETestState::Slide, Machine.Context) == ESetStateResult::ConditionFailed);
+	}
+
+	void TestDetectionPriority()
+	{
+		FTestMachine Machine;
+		FTestCore& Core = Machine.Core;
+		Core.SetState(ETestState::Walk, Machine.Context);
+		Machine.TakeLog();
+
+		//Every detector switches. Region 0 stops after Slide, and Aim is guarded against Slide, so entering Slide filters it out
+		//before its detector runs.
+		std::vector<ETestState> Called;
+		Core.Detect(~uint64_t(0), [&](const ETestState State, FTestState&)
+		{
+			Called.push_back(State);
+			Core.SetState(State, Machine.Context);
+			return false;
+		});
+		CHECK(Called.size() == 1 && Called[0] == ETestState::Slide);
+		CHECK(Core.IsActive(ETestState::Slide));
+		CHECK(!Core.IsActive(ETestState::Aim));
+		CHECK(Core.GetDetectionStats().Evaluated == 1);
+
+		//A clean dirty mask skips every detector.
+		int NumCalls = 0;
+		Core.Detect(0, [&](const ETestState, FTestState&) { NumCalls++; return false; });
+		CHECK(NumCalls == 0);
+		CHECK(Core.GetDetectionStats().SkippedUnchanged > 0);
+
+		//Returning true settles the region even without a switch, each region still runs its first detector.
+		Core.SetState(ETestState::Walk, Machine.Context);
+		NumCalls = 0;
+		Core.Detect(~uint64_t(0), [&](const ETestState, FTestState&) { NumCalls++; return true; });
+		CHECK(NumCalls == 2);
+	}
+
+	void TestSaveRestore()
+	{
+		FTestMachine Machine;
+		FTestCore& Core = Machine.Core;
+		Core.SetState(ETestState::Walk, Machine.Context);
+		Core.SetState(ETestState::Aim, Machine.Context);
+
+		uint8_t Saved[FTestCore::MaxNumRegions];
+		const uint32_t RunUpdateMask = Core.SaveCurrentStates(Saved);
+		const uint64_t SavedActive = Core.GetActiveMask();
+
+		Core.SetState(ETestState::Idle, Machine.Context);
+		Machine.TakeLog();
+		Core.RestoreCurrentStates(Saved, RunUpdateMask);
+		CHECK(Machine.TakeLog().empty());
+		CHECK(Core.GetActiveMask() == SavedActive);
+		CHECK(Core.GetCurrentEnumState(1) == ETestState::Aim);
+
+		Core.ClearCurrentStates();
+		CHECK(Core.GetCurrentState() == nullptr);
+		CHECK(Core.GetActiveMask() == 0);
+	}
+
+	void TestSharedDefinition()
+	{
+		FTestMachine First;
+		FTestMachine Second;
+		CHECK(First.Definition == Second.Definition);
+		Second.Definition.Table.Allow(ETestState::Walk, ETestState::Aim);
+		CHECK(!(First.Definition == Second.Definition));
+
+		//Two machines on one definition keep their own current states.
+		FTestCore Other;
+		FTestState OtherStates[NumTestStates];
+		Other.SetDefinition(First.Definition);
+		for (int Index = 0; Index < NumTestStates; ++Index) Other.BindState(static_cast<ETestState>(Index), &OtherStates[Index]);
+		FTestContext Context;
+		First.Core.SetState(ETestState::Walk, First.Context);
+		Other.SetState(ETestState::Walk, Context);
+		Other.SetState(ETestState::Slide, Context);
+		CHECK(First.Core.GetCurrentEnumState() == ETestState::Walk);
+		CHECK(Other.GetCurrentEnumState() == ETestState::Slide);
+	}
+
+	void TestDeltaEncoding()
+	{
+		std::vector<uint8_t> Previous(300);
+		for (std::size_t Index = 0; Index < Previous.size(); ++Index) Previous[Index] = static_cast<uint8_t>(Index);
+		std::vector<uint8_t> Current = Previous;
+
+		std::vector<uint8_t> Delta(GetMaxDeltaSize(Current.size()));
+		CHECK(EncodeDelta(Previous.data(), Current.data(), Current.size(), Delta.data()) == 0);
+
+		Current[3] = 0xAA;
+		Current[250] = 0xBB;
+		const std::size_t Written = EncodeDelta(Previous.data(), Current.data(), Current.size(), Delta.data());
+		CHECK(Written > 0 && Written < 16);
+
+		std::vector<uint8_t> Decoded(Current.size());
+		CHECK(DecodeDelta(Previous.data(), Delta.data(), Written, Decoded.size(), Decoded.data()));
+		CHECK(Decoded == Current);
+		CHECK(!DecodeDelta(Previous.data(), Delta.data(), Written, 100, Decoded.data()));
+	}
+
+	//A fixed mechanic set on TStaticStateMachine. The states are written against the context, so their detectors switch the static
+	//machine and not a runtime one.
+	struct FExampleOwner
+	{
+		ETestState Wanted = ETestState::Walk;
+		std::string Log;
+		std::string Detectors;
+	};
+
+	template <ETestState Enum, char Name>
+	struct TExampleState
+	{
+		template <typename ContextType> bool OnSetStateConditionCheck(ContextType&) { return true; }
+		template <typename ContextType> void OnEnterState(ContextType& Context) { Context.Owner.Log += '+'; Context.Owner.Log += Name; }
+		template <typename ContextType> void OnUpdateState(ContextType& Context) { Context.Owner.Log += 'u'; Context.Owner.Log += Name; }
+		template <typename ContextType> void OnExitState(ContextType& Context) { Context.Owner.Log += '-'; Context.Owner.Log += Name; }
+
+		template <typename ContextType>
+		void OverrideDetectState(ContextType& Context)
+		{
+			Context.Owner.Detectors += Name;
+			if (Context.Owner.Wanted == Enum) Context.SetState(Enum);
+		}
+	};
+
+	constexpr TTransitionTable<ETestState, NumTestStates> BuildExampleTransitions()
+	{
+		TTransitionTable<ETestState, NumTestStates> Table;
+		Table.Allow(ETestState::Walk, ETestState::Slide);
+		Table.Allow(ETestState::Walk, ETestState::Idle);
+		Table.Allow(ETestState::Slide, ETestState::Walk);
+		return Table;
+	}
+
+	struct FExampleTransitions
+	{
+		static constexpr TTransitionTable<ETestState, NumTestStates> Table = BuildExampleTransitions();
+	};
+
+	using FExampleWalk = TExampleState<ETestState::Walk, 'W'>;
+	using FExampleSlide = TExampleState<ETestState::Slide, 'S'>;
+	using FExampleIdle = TExampleState<ETestState::Idle, 'I'>;
+	using FExampleMachine = TStaticStateMachine<FExampleTransitions,
+		TStateBinding<ETestState::Walk, FExampleWalk>,
+		TStateBinding<ETestState::Slide, FExampleSlide>,
+		TStateBinding<ETestState::Idle, FExampleIdle>>;
+	using FExampleContext = TStaticStateMachineContext<FExampleMachine, FExampleOwner>;
+
+	void TestStaticStateMachine()
+	{
+		static_assert(FExampleMachine::CanTransition(ETestState::Walk, ETestState::Slide), "The table is built at compile time.");
+		static_assert(!FExampleMachine::CanTransition(ETestState::Slide, ETestState::Idle), "The table is built at compile time.");
+
+		FExampleWalk Walk;
+		FExampleSlide Slide;
+		FExampleIdle Idle;
+		FExampleMachine Machine;
+		Machine.Bind(&Walk, &Slide, &Idle);
+		FExampleOwner Owner;
+		FExampleContext Context(Machine, Owner);
+
+		CHECK(Context.SetState(ETestState::Walk) == ESetStateResult::Entered);
+		Machine.Update(Context);
+		CHECK(Owner.Log == "+WuW");
+
+		//Nothing switches, every detector enterable from Walk runs.
+		Machine.Detect(Context);
+		CHECK(Owner.Detectors == "SI");
+
+		//Slide's detector switches through the context, which stops Idle's from running.
+		Owner.Detectors.clear();
+		Owner.Log.clear();
+		Owner.Wanted = ETestState::Slide;
+		Machine.Detect(Context);
+		CHECK(Owner.Detectors == "S");
+		CHECK(Owner.Log == "-W+S");
+		CHECK(Machine.GetCurrentEnumState() == ETestState::Slide);
+
+		//Idle cannot be entered from Slide, so only Walk's detector runs.
+		Owner.Detectors.clear();
+		Owner.Wanted = ETestState::Idle;
+		Machine.Detect(Context);
+		CHECK(Owner.Detectors == "W");
+		CHECK(Context.SetState(ETestState::Idle) == ESetStateResult::Disallowed);
+	}
+}
+
+int main()
+{
+	TestTransitionTable();
+	TestRegionsAndGuards();
+	TestDetectionPriority();
+	TestSaveRestore();
+	TestSharedDefinition();
+	TestDeltaEncoding();
+	TestStaticStateMachine();
+
+	if (NumFailures != 0)
+	{
+		std::printf("%d check(s) failed\n", NumFailures);
+		return 1;
+	}
+	std::printf("All state machine core tests passed\n");
+	return 0;
+}
+
+#endif
@@ -2,6 +2,42 @@
 
 
 #include "StateComponentBase.h"
+#include "StateMachineSharedPool.h"
+#include "StateMechanicDefinition.h"
+
+namespace
+{
+	uint32 HashMechanicSettings(const FStateMechanicSettings& Settings)
+	{
+		uint32 Hash = HashCombine(GetTypeHash(Settings.TransitionFromMask), GetTypeHash(Settings.RequiredActiveMask));
+		Hash = HashCombine(Hash, GetTypeHash(Settings.BlockedByActiveMask));
+		Hash = HashCombine(Hash, GetTypeHash(Settings.DetectionVelocityThresholdSquared));
+		Hash = HashCombine(Hash, GetTypeHash(Settings.DetectionPollInterval));
+		Hash = HashCombine(Hash, GetTypeHash(static_cast<uint8>(Settings.DetectionDependencies)));
+		Hash = HashCombine(Hash, GetTypeHash(static_cast<uint8>(Settings.TraceLatency)));
+		Hash = HashCombine(Hash, GetTypeHash(Settings.CountTowardsFalling | Settings.ResetsDash << 1 | Settings.BroadcastBlueprintEvents << 2));
+		for (int32 Term = 0; Term < Settings.NumPredicateTerms; ++Term)
+		{
+			const FStatePredicateTerm& PredicateTerm = Settings.PredicateTerms[Term];
+			Hash = HashCombine(Hash, GetTypeHash(static_cast<uint8>(PredicateTerm.Input) | static_cast<uint8>(PredicateTerm.Comparison) << 4));
+			Hash = HashCombine(Hash, GetTypeHash(PredicateTerm.Threshold));
+		}
+		return Hash;
+	}
+
+	//Every distinct set of mechanic settings held by a registered mechanic. Game thread only, like OnRegister.
+	TStateMachineSharedPool<FStateMechanicSettings, &HashMechanicSettings> SharedMechanicSettings;
+
+	TArray<ECharacterState> MaskToStates(const uint64 Mask)
+	{
+		TArray<ECharacterState> States;
+		for (uint64 Remaining = Mask; Remaining != 0; Remaining &= Remaining - 1)
+		{
+			States.Add(static_cast<ECharacterState>(FMath::CountTrailingZeros64(Remaining)));
+		}
+		return States;
+	}
+}
 
 // Sets default values for this component's properties
 UStateComponentBase::UStateComponentBase()
@@ -10,25 +46,11 @@ UStateComponentBase::UStateComponentBase()
 	// off to improve performance if you don't need them.
 	PrimaryComponentTick.bCanEverTick = false;
 
-	//Adding all the possible states by default to Possible Transitions
-	UEnum* EnumPtr = FindObject<UEnum>(GetTransientPackage(), TEXT("ECharacterState"), true);
-	if (EnumPtr)
+	//Adding all the possible states by default to Possible Transitions. Every instance fills its own, the list is not copied from
+	//the archetype for native subobjects and new templates, and the editor cannot add entries to it.
+	for (int32 Index = 0; Index < NumCharacterStates; ++Index)
 	{
-		// Get the maximum valid enum value
-		const ECharacterState MaxEnumValue = static_cast<ECharacterState>(EnumPtr->GetMaxEnumValue());
-
-		for (int32 EnumIndex = 0; EnumIndex < EnumPtr->NumEnums(); ++EnumIndex)
-		{
-			ECharacterState EnumValue = static_cast<ECharacterState>(EnumPtr->GetValueByIndex(EnumIndex));
-
-			// Skip the maximum valid enum value. By default UE adds a 'MAX' value to UEnums, which I don't want or need on the list.
-			if (EnumValue == MaxEnumValue)
-			{
-				continue;
-			}
-
-			CanTransitionFromStateList.Add(EnumValue, true); // Set the default value to true
-		}
+		CanTransitionFromStateList.Add(static_cast<ECharacterState>(Index), true); // Set the default value to true
 	}
 	// ...
 }
@@ -39,12 +61,137 @@ void UStateComponentBase::BeginPlay()
 {
 	Super::BeginPlay();
 
-	PlayerCapsule = GetOwner()->GetComponentByClass<UCapsuleComponent>();
-	PlayerMovement = GetOwner()->GetComponentByClass<UCharacterMovementComponent>();
+	//Characters hand out their capsule and movement directly, only other owners need the component search.
 	PlayerCharacter = Cast<AMyCharacter>(GetOwner());
+	if (const ACharacter* Character = Cast<ACharacter>(GetOwner()))
+	{
+		PlayerCapsule = Character->GetCapsuleComponent();
+		PlayerMovement = Character->GetCharacterMovement();
+	}
+	else
+	{
+		PlayerCapsule = GetOwner()->GetComponentByClass<UCapsuleComponent>();
+		PlayerMovement = GetOwner()->GetComponentByClass<UCharacterMovementComponent>();
+	}
+
+	TraceQueryParams = FCollisionQueryParams(SCENE_QUERY_STAT(StateComponentTrace), false, GetOwner());
+
+	if (EnumHasAnyFlags(GetSettings().DetectionDependencies, EDetectionDependency::Overlap) && PlayerCapsule != nullptr)
+	{
+		PlayerCapsule->OnComponentBeginOverlap.AddDynamic(this, &UStateComponentBase::OnOwnerBeginOverlap);
+		PlayerCapsule->OnComponentEndOverlap.AddDynamic(this, &UStateComponentBase::OnOwnerEndOverlap);
+	}
 	// ...
 }
 
+void UStateComponentBase::OnRegister()
+{
+	Super::OnRegister();
+	RefreshSettings();
+}
+
+void UStateComponentBase::OnUnregister()
+{
+	//Settings shared with nobody else are freed here.
+	SharedMechanicSettings.Release(Settings);
+	Settings = nullptr;
+	Super::OnUnregister();
+}
+
+TMap<ECharacterState, bool> UStateComponentBase::GetTransitionList() const
+{
+	TMap<ECharacterState, bool> List;
+	List.Reserve(NumCharacterStates);
+	for (int32 Index = 0; Index < NumCharacterStates; ++Index)
+	{
+		List.Add(static_cast<ECharacterState>(Index), ((GetSettings().TransitionFromMask >> Index) & 1) != 0);
+	}
+	return List;
+}
+
+TArray<ECharacterState> UStateComponentBase::GetRequiredActiveStates() const
+{
+	return MaskToStates(GetSettings().RequiredActiveMask);
+}
+
+TArray<ECharacterState> UStateComponentBase::GetBlockedByActiveStates() const
+{
+	return MaskToStates(GetSettings().BlockedByActiveMask);
+}
+
+template <typename SourceType>
+FStateMechanicSettings UStateComponentBase::CompileSettings(const SourceType& Source)
+{
+	FStateMechanicSettings Compiled;
+
+	//States missing from the list are allowed, the same default the constructor gives them.
+	Compiled.TransitionFromMask = FStateTransitionTable::AllStatesMask;
+	for (const TPair<ECharacterState, bool>& Entry : Source.CanTransitionFromStateList)
+	{
+		if (!Entry.Value) Compiled.TransitionFromMask &= ~StateMachineCore::StateBit(Entry.Key);
+	}
+	for (const ECharacterState Required : Source.RequiredActiveStates) Compiled.RequiredActiveMask |= StateMachineCore::StateBit(Required);
+	for (const ECharacterState Blocked : Source.BlockedByActiveStates) Compiled.BlockedByActiveMask |= StateMachineCore::StateBit(Blocked);
+
+	Compiled.DetectionVelocityThresholdSquared = FMath::Square(Source.DetectionVelocityThreshold);
+	Compiled.DetectionPollInterval = Source.DetectionPollInterval;
+	Compiled.DetectionDependencies = static_cast<EDetectionDependency>(Source.DetectionDependencies);
+	Compiled.TraceLatency = Source.TraceLatency;
+	Compiled.CountTowardsFalling = Source.CountTowardsFalling;
+	Compiled.ResetsDash = Source.ResetsDash;
+	Compiled.BroadcastBlueprintEvents = Source.BroadcastBlueprintEvents;
+
+	Compiled.NumPredicateTerms = FMath::Min(Source.DetectionPredicate.Num(), FStateMechanicSettings::MaxPredicateTerms);
+	for (int32 Term = 0; Term < Compiled.NumPredicateTerms; ++Term)
+	{
+		Compiled.PredicateTerms[Term] = Source.DetectionPredicate[Term];
+	}
+	if (Source.DetectionPredicate.Num() > FStateMechanicSettings::MaxPredicateTerms)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("%s has %d detection predicate terms, only the first %d are used."), *Source.GetName(),
+			Source.DetectionPredicate.Num(), FStateMechanicSettings::MaxPredicateTerms);
+	}
+	return Compiled;
+}
+
+FStateMechanicSettings UStateComponentBase::BuildSettings() const
+{
+	return Definition != nullptr ? CompileSettings(*Definition) : CompileSettings(*this);
+}
+
+void UStateComponentBase::RefreshSettings()
+{
+	//Acquired before the old ones are released, so settings that did not change are not freed and added again.
+	const FStateMechanicSettings* Previous = Settings;
+	Settings = &SharedMechanicSettings.Acquire(BuildSettings());
+	SharedMechanicSettings.Release(Previous);
+
+	//With a Definition, this instance's own copy of the editable settings is never read again, not even when compiling again.
+	//Editor worlds keep theirs, they are what the details panel shows and what gets saved.
+	const UWorld* World = GetWorld();
+	if (Definition != nullptr && World != nullptr && World->IsGameWorld())
+	{
+		CanTransitionFromStateList.Empty();
+		RequiredActiveStates.Empty();
+		BlockedByActiveStates.Empty();
+	}
+}
+
+SIZE_T UStateComponentBase::GetSharedSettingsSize(int32& OutNumSettings)
+{
+	OutNumSettings = SharedMechanicSettings.Num();
+	return SharedMechanicSettings.GetAllocatedSize();
+}
+
+void UStateComponentBase::GetResourceSizeEx(FResourceSizeEx& CumulativeResourceSize)
+{
+	Super::GetResourceSizeEx(CumulativeResourceSize);
+
+	CumulativeResourceSize.AddDedicatedSystemMemoryBytes(GetEditableSettingsSize() + PendingTraces.GetAllocatedSize() + InFlightTraces.GetAllocatedSize()
+		+ QueuedTraceResults.GetAllocatedSize() + EnterStateNativeEvent.GetAllocatedSize() + UpdateStateNativeEvent.GetAllocatedSize()
+		+ ExitStateNativeEvent.GetAllocatedSize());
+}
+
 
 // Called every frame
 void UStateComponentBase::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
@@ -59,20 +206,28 @@ bool UStateComponentBase::OnSetStateConditionCheck(UCharacterStateMachine& SM)
 
 void UStateComponentBase::OnEnterState(UCharacterStateMachine& SM)
 {
-	OnEnterStateDelegate.Broadcast();
-	if (!CountTowardsFalling) PlayerCharacter->ResetFalling();
-	if (ResetsDash) PlayerCharacter->ResetDash();
+	if (Settings->BroadcastBlueprintEvents && OnEnterStateDelegate.IsBound()) OnEnterStateDelegate.Broadcast();
+	if (EnterStateNativeEvent.IsBound()) EnterStateNativeEvent.Broadcast(*this);
+	if (!Settings->CountTowardsFalling) PlayerCharacter->ResetFalling();
+	if (Settings->ResetsDash) PlayerCharacter->ResetDash();
 }
 
 void UStateComponentBase::OnUpdateState(UCharacterStateMachine& SM)
 {
-	OnUpdateStateDelegate.Broadcast();
+	if (Settings->BroadcastBlueprintEvents && OnUpdateStateDelegate.IsBound()) OnUpdateStateDelegate.Broadcast();
+	if (UpdateStateNativeEvent.IsBound()) UpdateStateNativeEvent.Broadcast(*this);
+}
+
+void UStateComponentBase::OnUpdateState(UCharacterStateMachine& SM, const float DeltaTime)
+{
+	OnUpdateState(SM);
 }
 
 void UStateComponentBase::OnExitState(UCharacterStateMachine& SM)
 {
-	OnExitStateDelegate.Broadcast();
-	if (!CountTowardsFalling) PlayerCharacter->ResetFalling();
+	if (Settings->BroadcastBlueprintEvents && OnExitStateDelegate.IsBound()) OnExitStateDelegate.Broadcast();
+	if (ExitStateNativeEvent.IsBound()) ExitStateNativeEvent.Broadcast(*this);
+	if (!Settings->CountTowardsFalling) PlayerCharacter->ResetFalling();
 }
 
 void UStateComponentBase::OverrideMovementInput(UCharacterStateMachine& SM, FVector2d& NewMovementVector)
@@ -87,28 +242,216 @@ void UStateComponentBase::OverrideCameraInput(UCharacterStateMachine& SM, FVecto
 {
 }
 
+void UStateComponentBase::ApplyOverrides(UCharacterStateMachine& SM, FStateInputOverrides& Inputs, const EStateInputChannel Channels)
+{
+	if (EnumHasAnyFlags(Channels, EStateInputChannel::Movement)) OverrideMovementInput(SM, Inputs.MovementVector);
+	if (EnumHasAnyFlags(Channels, EStateInputChannel::Acceleration)) OverrideAcceleration(SM, Inputs.Acceleration);
+	if (EnumHasAnyFlags(Channels, EStateInputChannel::Camera)) OverrideCameraInput(SM, Inputs.CameraRotation);
+}
+
 void UStateComponentBase::OverrideDetectState(UCharacterStateMachine& SM)
 {
 }
 
+bool UStateComponentBase::QueryDetectState(const UCharacterStateMachine& SM) const
+{
+	return false;
+}
+
+bool UStateComponentBase::ConsumeDetectionDirty(const FStateDetectionContext& Context)
+{
+	const EDetectionDependency Dependencies = Settings->DetectionDependencies;
+
+	bool Dirty = Dependencies == EDetectionDependency::None || !HasDetected || Context.ActiveStates != LastDetectionContext.ActiveStates;
+	if (!Dirty && EnumHasAnyFlags(Dependencies, EDetectionDependency::Velocity))
+	{
+		Dirty = FVector::DistSquared(Context.Velocity, LastDetectionContext.Velocity) > Settings->DetectionVelocityThresholdSquared;
+	}
+	if (!Dirty && EnumHasAnyFlags(Dependencies, EDetectionDependency::Grounded))
+	{
+		Dirty = Context.Grounded != LastDetectionContext.Grounded;
+	}
+	if (!Dirty && EnumHasAnyFlags(Dependencies, EDetectionDependency::Input))
+	{
+		Dirty = Context.InputSerial != LastDetectionContext.InputSerial;
+	}
+	if (!Dirty && EnumHasAnyFlags(Dependencies, EDetectionDependency::Overlap))
+	{
+		Dirty = OverlapChanged;
+	}
+	if (!Dirty && EnumHasAnyFlags(Dependencies, EDetectionDependency::Timer))
+	{
+		Dirty = Context.Time >= NextDetectionPollTime;
+	}
+
+	if (Dirty)
+	{
+		LastDetectionContext = Context;
+		NextDetectionPollTime = Context.Time + Settings->DetectionPollInterval;
+		OverlapChanged = false;
+		HasDetected = true;
+	}
+	return Dirty;
+}
+
+void UStateComponentBase::OnOwnerBeginOverlap(UPrimitiveComponent* OverlappedComponent, AActor* OtherActor, UPrimitiveComponent* OtherComp,
+	int32 OtherBodyIndex, bool bFromSweep, const FHitResult& SweepResult)
+{
+	OverlapChanged = true;
+}
+
+void UStateComponentBase::OnOwnerEndOverlap(UPrimitiveComponent* OverlappedComponent, AActor* OtherActor, UPrimitiveComponent* OtherComp, int32 OtherBodyIndex)
+{
+	OverlapChanged = true;
+}
+
 void UStateComponentBase::OverrideDebug()
 {
 }
 
+void UStateComponentBase::ResetDetectionState()
+{
+	LastDetectionContext = FStateDetectionContext();
+	NextDetectionPollTime = 0;
+	OverlapChanged = false;
+	HasDetected = false;
+
+	//Reset keeps the allocations, a reused owner queues the same traces again.
+	PendingTraces.Reset();
+	InFlightTraces.Reset();
+	QueuedTraceResults.Reset();
+	NumQueuedTraces = 0;
+}
+
+int32 UStateComponentBase::GetSnapshotSize() const
+{
+	return 0;
+}
+
+void UStateComponentBase::SaveSnapshot(uint8* Data) const
+{
+}
+
+void UStateComponentBase::RestoreSnapshot(const uint8* Data)
+{
+}
+
+#if WITH_EDITOR
+void UStateComponentBase::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)
+{
+	Super::PostEditChangeProperty(PropertyChangedEvent);
+
+	if (PropertyChangedEvent.GetPropertyName() != GET_MEMBER_NAME_CHECKED(UStateComponentBase, DebugMechanic))
+	{
+		//Templates and class defaults are never registered, tools compile theirs with BuildSettings.
+		if (IsRegistered()) RefreshSettings();
+		return;
+	}
+	if (GetOwner() == nullptr) return;
+
+	if (UCharacterStateMachine* SM = GetOwner()->FindComponentByClass<UCharacterStateMachine>())
+	{
+		SM->RefreshDebugMechanics();
+	}
+}
+#endif
+
 #pragma region Helper Methods
 bool UStateComponentBase::LineTraceSingle(FHitResult& HitR, const FVector& Start, const FVector& End) const
 {
-	FCollisionQueryParams CollisionParams;
-	CollisionParams.AddIgnoredActor(GetOwner());
-	return GetWorld()->LineTraceSingleByChannel(HitR, Start, End, ECC_Visibility, CollisionParams);
+	return GetWorld()->LineTraceSingleByChannel(HitR, Start, End, ECC_Visibility, TraceQueryParams);
 }
 
 bool UStateComponentBase::LineTraceSingle(const FVector& Start, const FVector& End) const
 {
-	FHitResult HitR;
-	FCollisionQueryParams CollisionParams;
-	CollisionParams.AddIgnoredActor(GetOwner());
-	return GetWorld()->LineTraceSingleByChannel(HitR, Start, End, ECC_Visibility, CollisionParams);
+	//No HitResult needed, so a test trace is enough.
+	return GetWorld()->LineTraceTestByChannel(Start, End, ECC_Visibility, TraceQueryParams);
+}
+
+int32 UStateComponentBase::QueueLineTrace(const FVector& Start, const FVector& End)
+{
+	const int32 Slot = NumQueuedTraces++;
+	if (!QueuedTraceResults.IsValidIndex(Slot))
+	{
+		QueuedTraceResults.SetNum(Slot + 1);
+	}
+
+	if (Settings->TraceLatency == EStateTraceLatency::SameFrame)
+	{
+		LineTraceSingle(QueuedTraceResults[Slot], Start, End);
+	}
+	else
+	{
+		PendingTraces.Add({Start, End});
+	}
+	return Slot;
+}
+
+bool UStateComponentBase::GetQueuedTraceResult(const int32 Slot, FHitResult& HitR) const
+{
+	if (!QueuedTraceResults.IsValidIndex(Slot)) return false;
+
+	HitR = QueuedTraceResults[Slot];
+	return HitR.bBlockingHit;
+}
+
+void UStateComponentBase::ResolveQueuedTraces()
+{
+	//Every detection queues from slot zero. A fixed timestep step that detects again in the same frame drops what the step before
+	//it queued, only the last step's traces are submitted.
+	NumQueuedTraces = 0;
+	PendingTraces.Reset();
+
+	//Submitted this frame, the results are not there yet.
+	if (!HasUnresolvedTraces || TraceSubmitFrame == GFrameCounter) return;
+	HasUnresolvedTraces = false;
+
+	//Resolved too late, the handles would read as no hit. The last results are kept instead.
+	if (TraceSubmitFrame + 1 != GFrameCounter && !InFlightTraces.IsEmpty())
+	{
+		InFlightTraces.Reset();
+		return;
+	}
+
+	const UWorld* World = GetWorld();
+	FTraceDatum Datum;
+	for (int32 Slot = 0; Slot < InFlightTraces.Num(); ++Slot)
+	{
+		FHitResult& Result = QueuedTraceResults[Slot];
+		if (World->QueryTraceData(InFlightTraces[Slot], Datum) && !Datum.OutHits.IsEmpty())
+		{
+			Result = Datum.OutHits[0];
+		}
+		else
+		{
+			Result.Reset();
+		}
+	}
+
+	//Slots that were not submitted last frame, because the detector queued fewer traces or did not run, have no result.
+	for (int32 Slot = InFlightTraces.Num(); Slot < QueuedTraceResults.Num(); ++Slot)
+	{
+		QueuedTraceResults[Slot].Reset();
+	}
+	InFlightTraces.Reset();
+}
+
+bool UStateComponentBase::SubmitQueuedTraces()
+{
+	//Handles not resolved in time are dropped, slots restart from zero with every submission.
+	InFlightTraces.Reset();
+	TraceSubmitFrame = GFrameCounter;
+	HasUnresolvedTraces = true;
+	if (PendingTraces.IsEmpty()) return false;
+
+	//The world runs every async trace of the frame together once the frame's ticking is done.
+	UWorld* World = GetWorld();
+	for (const FQueuedTrace& Trace : PendingTraces)
+	{
+		InFlightTraces.Add(World->AsyncLineTraceByChannel(EAsyncTraceType::Single, Trace.Start, Trace.End, ECC_Visibility, TraceQueryParams));
+	}
+	PendingTraces.Reset();
+	return true;
 }
 
 FVector UStateComponentBase::RotateVector(const FVector& InVector, const float AngleInDegrees, const float Length)
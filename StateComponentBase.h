@@ -10,7 +10,86 @@
 #include "StateComponentBase.generated.h"
 
 class UCharacterStateMachine;
+class UStateMechanicDefinition;
 
+UENUM(BlueprintType)
+enum class EStateTraceLatency : uint8
+{
+	//Queued traces run synchronously as soon as they are queued, results are readable right away.
+	SameFrame,
+	//Queued traces are submitted together as async traces after detection, results are readable during the next frame's detection.
+	NextFrame,
+};
+
+//What a mechanic's detection depends on. The state machine only re-runs a detector when one of these changed since it last ran.
+UENUM(meta = (Bitflags, UseEnumValuesAsMaskValuesInEditor = "true"))
+enum class EDetectionDependency : uint8
+{
+	None = 0 UMETA(Hidden),
+	//Velocity changed by more than DetectionVelocityThreshold.
+	Velocity = 1 << 0,
+	//Character landed or left the ground.
+	Grounded = 1 << 1,
+	//Movement input changed.
+	Input = 1 << 2,
+	//Owner capsule started or stopped overlapping something.
+	Overlap = 1 << 3,
+	//DetectionPollInterval seconds passed.
+	Timer = 1 << 4,
+};
+ENUM_CLASS_FLAGS(EDetectionDependency);
+
+//Settings of a mechanic in the form the state machine reads at runtime. Mechanics with the same settings all point at one of these,
+//see UStateComponentBase::GetSettings, so a thousand characters with the same five mechanics keep five of them, not five thousand.
+struct FStateMechanicSettings
+{
+	//States this mechanic can be entered from, compiled from CanTransitionFromStateList.
+	uint64 TransitionFromMask = 0;
+	//RequiredActiveStates and BlockedByActiveStates as masks.
+	uint64 RequiredActiveMask = 0;
+	uint64 BlockedByActiveMask = 0;
+	float DetectionVelocityThresholdSquared = 0;
+	float DetectionPollInterval = 0;
+	EDetectionDependency DetectionDependencies = EDetectionDependency::None;
+	EStateTraceLatency TraceLatency = EStateTraceLatency::SameFrame;
+	bool CountTowardsFalling = false;
+	bool ResetsDash = false;
+	bool BroadcastBlueprintEvents = false;
+
+	//Declarative detection, see UStateComponentBase::DetectionPredicate. Zero terms means the mechanic detects itself.
+	static constexpr int32 MaxPredicateTerms = 4;
+	int32 NumPredicateTerms = 0;
+	FStatePredicateTerm PredicateTerms[MaxPredicateTerms];
+
+	bool UsesPredicate() const { return NumPredicateTerms > 0; }
+
+	//True if every term of the predicate holds for Inputs, NumPredicateInputs values indexed by EStatePredicateInput.
+	bool EvaluatePredicate(const float* Inputs) const
+	{
+		for (int32 Term = 0; Term < NumPredicateTerms; ++Term)
+		{
+			if (!PredicateTerms[Term].Evaluate(Inputs)) return false;
+		}
+		return true;
+	}
+
+	bool operator==(const FStateMechanicSettings& Other) const
+	{
+		if (NumPredicateTerms != Other.NumPredicateTerms) return false;
+		for (int32 Term = 0; Term < NumPredicateTerms; ++Term)
+		{
+			if (!(PredicateTerms[Term] == Other.PredicateTerms[Term])) return false;
+		}
+
+		return TransitionFromMask == Other.TransitionFromMask && RequiredActiveMask == Other.RequiredActiveMask
+			&& BlockedByActiveMask == Other.BlockedByActiveMask && DetectionVelocityThresholdSquared == Other.DetectionVelocityThresholdSquared
+			&& DetectionPollInterval == Other.DetectionPollInterval && DetectionDependencies == Other.DetectionDependencies
+			&& TraceLatency == Other.TraceLatency && CountTowardsFalling == Other.CountTowardsFalling && ResetsDash == Other.ResetsDash
+			&& BroadcastBlueprintEvents == Other.BroadcastBlueprintEvents;
+	}
+};
+
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnStateNativeEvent, UStateComponentBase& /*State*/);
 
 UCLASS(ClassGroup = (Custom), BlueprintType, Blueprintable, meta = (BlueprintSpawnableComponent))
 class CHASING_5SD073_API UStateComponentBase : public UActorComponent
@@ -25,6 +104,16 @@ protected:
 	// Called when the game starts
 	virtual void BeginPlay() override;
 
+	//Compiles the settings, see RefreshSettings. Runs before BeginPlay, so they are ready by the time the state machine is set up.
+	virtual void OnRegister() override;
+	virtual void OnUnregister() override;
+
+#if WITH_EDITOR
+	//Keeps the owner's state machine in sync when DebugMechanic is toggled in the details panel during play, and recompiles the
+	//settings when anything else changes.
+	virtual void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent) override;
+#endif
+
 	UPROPERTY()
 	UCapsuleComponent* PlayerCapsule = nullptr;
 
@@ -34,10 +123,22 @@ protected:
 	UPROPERTY()
 	AMyCharacter* PlayerCharacter = nullptr;
 
+	UPROPERTY(EditAnywhere, Category = "Settings|General Settings",
+		meta = (ToolTip = "Settings shared by every character using this mechanic. When set, the settings below except the debug ones are ignored."))
+	UStateMechanicDefinition* Definition = nullptr;
+
 	UPROPERTY(EditFixedSize, EditAnywhere, Category = "Settings|General Settings",
 		meta = (ToolTip = "The list describes FROM which states this state can transtion"))
 	TMap<ECharacterState, bool> CanTransitionFromStateList;
 
+	UPROPERTY(EditAnywhere, Category = "Settings|Regions",
+		meta = (ToolTip = "This state can only be entered while all of these are active in other regions of the state machine."))
+	TArray<ECharacterState> RequiredActiveStates;
+
+	UPROPERTY(EditAnywhere, Category = "Settings|Regions",
+		meta = (ToolTip = "This state cannot be entered while any of these is active in another region of the state machine."))
+	TArray<ECharacterState> BlockedByActiveStates;
+
 	UPROPERTY(EditAnywhere, Category= "Settings|General Settings") //Dont add space after general!
 	bool CountTowardsFalling = false;
 
@@ -50,6 +151,37 @@ protected:
 	UPROPERTY(EditAnywhere, Category = "Settings|General Settings")
 	FColor DebugColor;
 
+	UPROPERTY(EditAnywhere, Category = "Settings|General Settings",
+		meta = (ToolTip = "Broadcasts the On Enter, On Update and On Exit Blueprint events. Leave off if nothing in Blueprints listens to them."))
+	bool BroadcastBlueprintEvents = false;
+
+	//Set this in the constructor of mechanics that implement QueryDetectState instead of OverrideDetectState.
+	bool ParallelDetection = false;
+
+	//Every channel by default, so an override always runs. Mechanics that leave some or all input alone can narrow it, in the
+	//constructor or here, and the state machine skips those channels, or the whole call when none are left.
+	UPROPERTY(EditAnywhere, Category = "Settings|General Settings", meta = (Bitmask, BitmaskEnum = "/Script/Chasing_5SD073.EStateInputChannel",
+		ToolTip = "Input channels this mechanic's input overrides change. Channels left out are never handed to it."))
+	int32 OverriddenInputChannels = static_cast<int32>(EStateInputChannel::All);
+
+	UPROPERTY(EditAnywhere, Category = "Settings|General Settings",
+		meta = (ToolTip = "When the results of traces queued with QueueLineTrace become readable."))
+	EStateTraceLatency TraceLatency = EStateTraceLatency::SameFrame;
+
+	UPROPERTY(EditAnywhere, Category = "Settings|Detection Settings", meta = (Bitmask, BitmaskEnum = "/Script/Chasing_5SD073.EDetectionDependency",
+		ToolTip = "What detection of this mechanic depends on. Leave empty to detect every frame. A change of the current state always re-runs detection."))
+	int32 DetectionDependencies = 0;
+
+	UPROPERTY(EditAnywhere, Category = "Settings|Detection Settings", meta = (ClampMin = 0))
+	float DetectionVelocityThreshold = 10;
+
+	UPROPERTY(EditAnywhere, Category = "Settings|Detection Settings", meta = (ClampMin = 0))
+	float DetectionPollInterval = 0.25f;
+
+	UPROPERTY(EditAnywhere, Category = "Settings|Detection Settings", meta = (
+		ToolTip = "Enters this mechanic when all of these hold, instead of calling OverrideDetectState. Batched machines test them for all characters at once. At most 4."))
+	TArray<FStatePredicateTerm> DetectionPredicate;
+
 public:
 	// Called every frame
 	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
@@ -68,26 +200,100 @@ public:
 	//This is constantly executed during the state between OnEnterStateEvent and OnExitStateEvent. Do not completely override, leave the base.
 	virtual void OnUpdateState(UCharacterStateMachine& SM);
 
+	//What the state machine calls. DeltaTime is the fixed step in fixed timestep mode, the time since the last update otherwise.
+	//Override this one to simulate with an explicit delta, the base calls the overload above so existing mechanics keep working.
+	virtual void OnUpdateState(UCharacterStateMachine& SM, const float DeltaTime);
+
 	//This is executed at the ending of the state. Do not completely override, leave the base.
 	virtual void OnExitState(UCharacterStateMachine& SM);
 
+	//Only called for the channels in OverriddenInputChannels.
 	virtual void OverrideMovementInput(UCharacterStateMachine& SM, FVector2d& NewMovementVector);
 
 	virtual void OverrideAcceleration(UCharacterStateMachine& SM, float& NewSpeed);
 
 	virtual void OverrideCameraInput(UCharacterStateMachine& SM, FVector2d& NewRotationVector);
 
+	//Single entry point for all per-frame input overrides. Channels is what the caller supplied, masked by OverriddenInputChannels.
+	//The base calls the three overrides above for those channels. Override this to handle them all in one call.
+	virtual void ApplyOverrides(UCharacterStateMachine& SM, FStateInputOverrides& Inputs, const EStateInputChannel Channels);
+
 	//This for mechanics that require automated triggers rather than manual one. State machine will make sure a mechanic will not try to detect itself
 	//Or if the mechanic prohibits transitioning from the current state.
+	//Not called for mechanics with a DetectionPredicate, the predicate decides instead.
 	virtual void OverrideDetectState(UCharacterStateMachine& SM);
 
+	//Read-only version of OverrideDetectState for mechanics that set ParallelDetection. Instead of switching state, return true
+	//if this mechanic should be entered. It can run on a worker thread, so only read state and do scene queries (line traces are fine).
+	//The state machine commits the result through SetState on the game thread, in hierarchy order.
+	virtual bool QueryDetectState(const UCharacterStateMachine& SM) const;
+
 	//This runs in Debug
 	virtual void OverrideDebug();
 
-	bool DoesItCountTowardsFalling() const { return CountTowardsFalling; }
-	bool DoesItResetDash() const { return ResetsDash; }
+	bool DoesItCountTowardsFalling() const { return GetSettings().CountTowardsFalling; }
+	bool DoesItResetDash() const { return GetSettings().ResetsDash; }
 	bool GetDebugMechanic() const { return DebugMechanic; }
-	TMap<ECharacterState, bool> GetTransitionList() const { return CanTransitionFromStateList; }
+	bool SupportsParallelDetection() const { return ParallelDetection; }
+
+	//Forgets everything detection gating and queued traces remember, so a pooled owner starts over like a fresh spawn.
+	void ResetDetectionState();
+
+	//Rollback hooks. Mechanics with runtime data that changes how they simulate override all three. The data has a fixed size and
+	//is copied as raw bytes: SaveSnapshot writes exactly GetSnapshotSize bytes and RestoreSnapshot reads the same bytes back.
+	//Keep it to plain values, no pointers, so snapshots stay small and can be delta encoded.
+	virtual int32 GetSnapshotSize() const;
+	virtual void SaveSnapshot(uint8* Data) const;
+	virtual void RestoreSnapshot(const uint8* Data);
+	EStateInputChannel GetOverriddenInputChannels() const { return static_cast<EStateInputChannel>(OverriddenInputChannels); }
+
+	//Native hooks for C++ listeners. Unlike the Blueprint events they are always broadcast, but only when something is bound.
+	FOnStateNativeEvent& OnEnterStateNative() { return EnterStateNativeEvent; }
+	FOnStateNativeEvent& OnUpdateStateNative() { return UpdateStateNativeEvent; }
+	FOnStateNativeEvent& OnExitStateNative() { return ExitStateNativeEvent; }
+
+	//Called by the state machine before detection. Returns true if anything this mechanic's detection depends on changed since it
+	//was last dirty, and remembers the context as the new baseline.
+	bool ConsumeDetectionDirty(const FStateDetectionContext& Context);
+
+	//Called by the state machine around detection. Reads back last frame's async traces, then submits the ones queued this frame.
+	//Resolving more than once a frame only reads the first time, later calls just restart the queue. Submit returns true if any
+	//trace went out.
+	void ResolveQueuedTraces();
+	bool SubmitQueuedTraces();
+
+	//The settings the state machine and this mechanic read at runtime, from Definition if set or from this component otherwise.
+	//Shared with every other mechanic that has the same settings. Mechanics reading their settings should use this.
+	const FStateMechanicSettings& GetSettings() const
+	{
+		checkSlow(Settings != nullptr);
+		return *Settings;
+	}
+
+	//Compiles the settings without sharing them, for tools working on component templates that are never registered.
+	FStateMechanicSettings BuildSettings() const;
+
+	//The compiled settings as the lists they were edited as, built from the shared masks on each call.
+	TMap<ECharacterState, bool> GetTransitionList() const;
+	TArray<ECharacterState> GetRequiredActiveStates() const;
+	TArray<ECharacterState> GetBlockedByActiveStates() const;
+
+	//Compiles the settings again and points this mechanic at the shared copy of them. Runs on register, call it after changing
+	//Definition or the settings at runtime, then set up the owner's state machine again. Registered mechanics only, the shared
+	//copy is given back on unregister.
+	void RefreshSettings();
+
+	//Bytes allocated by this mechanic's own copy of the editable settings, empty in game worlds once a Definition replaces them.
+	SIZE_T GetEditableSettingsSize() const
+	{
+		return CanTransitionFromStateList.GetAllocatedSize() + RequiredActiveStates.GetAllocatedSize() + BlockedByActiveStates.GetAllocatedSize();
+	}
+
+	//Bytes held by the pool of shared settings, and how many distinct settings are in it.
+	static SIZE_T GetSharedSettingsSize(int32& OutNumSettings);
+
+	//Counts the containers of this mechanic, for memreport and StateMachine.MemoryReport. The shared settings are not counted here.
+	virtual void GetResourceSizeEx(FResourceSizeEx& CumulativeResourceSize) override;
 
 protected:
 	//Helper Methods
@@ -96,6 +302,14 @@ protected:
 	bool LineTraceSingle(FHitResult& HitR, const FVector& Start, const FVector& End) const;
 	//Line Trace Single Channel, used when HitResult is not needed. Return true if there is a hit. Automatically ignores Owner and uses ECC_Visibility.
 	bool LineTraceSingle(const FVector& Start, const FVector& End) const;
+
+	//Queues a line trace for detection, same channel and ignore rules as LineTraceSingle. Call from OverrideDetectState, in the same
+	//order every frame. Returns the slot to read the result from with GetQueuedTraceResult. Depending on TraceLatency, the result is
+	//either readable right away or during the next frame's detection.
+	int32 QueueLineTrace(const FVector& Start, const FVector& End);
+	//Returns true if the queued trace in Slot hit something. Slots without a result yet count as no hit.
+	bool GetQueuedTraceResult(const int32 Slot, FHitResult& HitR) const;
+
 	static FVector RotateVector(const FVector& InVector, const float AngleInDegrees, const float Length = 1);
 
 
@@ -121,4 +335,50 @@ protected:
 
 	UPROPERTY(BlueprintAssignable, DisplayName= "On Condition Check Event")
 	FConditionCheckDelegate OnConditionCheckDelegate;
+
+private:
+	template <typename SourceType>
+	static FStateMechanicSettings CompileSettings(const SourceType& Source);
+
+	//Set by RefreshSettings, points into a pool of every distinct set of settings in use. Null while unregistered.
+	const FStateMechanicSettings* Settings = nullptr;
+
+	FOnStateNativeEvent EnterStateNativeEvent;
+	FOnStateNativeEvent UpdateStateNativeEvent;
+	FOnStateNativeEvent ExitStateNativeEvent;
+
+	UFUNCTION()
+	void OnOwnerBeginOverlap(UPrimitiveComponent* OverlappedComponent, AActor* OtherActor, UPrimitiveComponent* OtherComp,
+		int32 OtherBodyIndex, bool bFromSweep, const FHitResult& SweepResult);
+	UFUNCTION()
+	void OnOwnerEndOverlap(UPrimitiveComponent* OverlappedComponent, AActor* OtherActor, UPrimitiveComponent* OtherComp, int32 OtherBodyIndex);
+
+	//Context this mechanic was last detected with, compared against the new one to decide whether it is dirty.
+	FStateDetectionContext LastDetectionContext;
+	double NextDetectionPollTime = 0;
+	bool OverlapChanged = false;
+	//Forces the first detection to run regardless of dependencies.
+	bool HasDetected = false;
+
+	//Built once in BeginPlay and reused by every trace this component makes.
+	FCollisionQueryParams TraceQueryParams;
+
+	struct FQueuedTrace
+	{
+		FVector Start;
+		FVector End;
+	};
+
+	//Traces queued this frame that are waiting to be submitted, NextFrame latency only.
+	TArray<FQueuedTrace> PendingTraces;
+	//Async traces of the last submission, indexed by slot.
+	TArray<FTraceHandle> InFlightTraces;
+	//Frame of the last submission. The world only keeps async trace results during the frame after they were submitted.
+	uint64 TraceSubmitFrame = 0;
+	//Set by a submission, even an empty one, and cleared once it has been resolved.
+	bool HasUnresolvedTraces = false;
+	//Latest result of every slot. Kept allocated between frames.
+	TArray<FHitResult> QueuedTraceResults;
+	//Number of traces queued since the last submission.
+	int32 NumQueuedTraces = 0;
 };
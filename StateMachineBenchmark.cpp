@@ -0,0 +1,677 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "StateMachineBenchmark.h"
+#include "CharacterStateMachine.h"
+#include "StateComponentBase.h"
+#include "Engine/EngineTypes.h"
+#include "Engine/World.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/PlatformMemory.h"
+#include "Misc/App.h"
+#include "Misc/FileHelper.h"
+#include "Misc/MiscTrace.h"
+#include "Misc/Paths.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#include "UObject/StrongObjectPtr.h"
+
+namespace
+{
+	//Bump the version whenever the layout below or FStateMachineInputFrame changes.
+	constexpr uint32 InputFileMagic = 0x4E494D53; // "SMIN"
+	constexpr uint32 InputFileVersion = 1;
+	//Version of the JSON results, for the compare tool.
+	constexpr uint32 ResultsVersion = 3;
+
+	struct FInputFileHeader
+	{
+		uint32 Magic;
+		uint32 Version;
+		uint32 FrameSize;
+		uint32 NumFrames;
+	};
+
+	//Distance between spawned copies, so their traces and collision do not run into each other.
+	constexpr double SpawnSpacing = 500;
+
+	FString GetBenchmarkDir()
+	{
+		return FPaths::ProjectSavedDir() / TEXT("StateMachineBenchmarks");
+	}
+
+	//Relative paths on the command line are taken from the benchmark folder.
+	FString ResolveBenchmarkPath(const FString& Path)
+	{
+		return FPaths::IsRelative(Path) ? GetBenchmarkDir() / Path : Path;
+	}
+
+	UCharacterStateMachine* FindPlayerStateMachine(const UWorld& World)
+	{
+		const APlayerController* Player = World.GetFirstPlayerController();
+		const APawn* Pawn = Player != nullptr ? Player->GetPawn() : nullptr;
+		return Pawn != nullptr ? Pawn->FindComponentByClass<UCharacterStateMachine>() : nullptr;
+	}
+}
+
+#pragma region Recording
+
+void FStateMachineInputRecording::CaptureFrame(UCharacterStateMachine& Machine, const float DeltaTime)
+{
+	FStateMachineInputFrame& Frame = Frames.AddZeroed_GetRef();
+	Frame.RequestedStates = Machine.ConsumeExternalRequests();
+	Frame.MovementInput = FVector2f(Machine.GetLastMovementInput());
+	Frame.DeltaTime = DeltaTime;
+	Frame.CustomPredicateInputs[0] = Machine.GetCustomPredicateInput(EStatePredicateInput::Custom0);
+	Frame.CustomPredicateInputs[1] = Machine.GetCustomPredicateInput(EStatePredicateInput::Custom1);
+
+	if (const UCharacterMovementComponent* Movement = Machine.GetOwner()->FindComponentByClass<UCharacterMovementComponent>())
+	{
+		Frame.Velocity = FVector3f(Movement->Velocity);
+		Frame.Grounded = Movement->IsMovingOnGround() ? 1 : 0;
+	}
+}
+
+bool FStateMachineInputRecording::SaveToFile(const FString& FilePath) const
+{
+	FInputFileHeader Header;
+	Header.Magic = InputFileMagic;
+	Header.Version = InputFileVersion;
+	Header.FrameSize = sizeof(FStateMachineInputFrame);
+	Header.NumFrames = Frames.Num();
+
+	TArray<uint8> Bytes;
+	Bytes.Append(reinterpret_cast<const uint8*>(&Header), sizeof(Header));
+	Bytes.Append(reinterpret_cast<const uint8*>(Frames.GetData()), Frames.Num() * sizeof(FStateMachineInputFrame));
+	return FFileHelper::SaveArrayToFile(Bytes, *FilePath);
+}
+
+bool FStateMachineInputRecording::LoadFromFile(const FString& FilePath)
+{
+	Frames.Reset();
+
+	TArray<uint8> Bytes;
+	if (!FFileHelper::LoadFileToArray(Bytes, *FilePath) || Bytes.Num() < static_cast<int32>(sizeof(FInputFileHeader))) return false;
+
+	FInputFileHeader Header;
+	FMemory::Memcpy(&Header, Bytes.GetData(), sizeof(Header));
+	if (Header.Magic != InputFileMagic || Header.Version != InputFileVersion || Header.FrameSize != sizeof(FStateMachineInputFrame)
+		|| Bytes.Num() != static_cast<int64>(sizeof(Header)) + static_cast<int64>(Header.NumFrames) * sizeof(FStateMachineInputFrame))
+	{
+		return false;
+	}
+
+	Frames.SetNumUninitialized(Header.NumFrames);
+	FMemory::Memcpy(Frames.GetData(), Bytes.GetData() + sizeof(Header), Header.NumFrames * sizeof(FStateMachineInputFrame));
+	return true;
+}
+
+#pragma endregion
+
+#pragma region Benchmark
+
+void FStateMachineBenchmark::FHistogram::Reset()
+{
+	Buckets.Reset();
+	Buckets.SetNumZeroed(NumBuckets);
+	NumSamples = 0;
+	Max = 0;
+}
+
+void FStateMachineBenchmark::FHistogram::Add(const double Value)
+{
+	//Bucket 0 holds everything below MinValue, each one after it is 1/BucketsPerOctave of a doubling wide.
+	const int32 Bucket = Value < MinValue ? 0 : 1 + FMath::FloorToInt32(FMath::Log2(Value / MinValue) * BucketsPerOctave);
+	Buckets[FMath::Min(Bucket, NumBuckets - 1)]++;
+	NumSamples++;
+	Max = FMath::Max(Max, Value);
+}
+
+double FStateMachineBenchmark::FHistogram::GetPercentile(const double Percentile) const
+{
+	if (NumSamples == 0) return 0;
+
+	const uint64 Rank = FMath::Min(static_cast<uint64>(Percentile * NumSamples), NumSamples - 1);
+	uint64 Seen = 0;
+	for (int32 Bucket = 0; Bucket < NumBuckets; ++Bucket)
+	{
+		Seen += Buckets[Bucket];
+		if (Seen > Rank) return Bucket == 0 ? 0 : FMath::Min(MinValue * FMath::Pow(2.0, (Bucket - 1) / static_cast<double>(BucketsPerOctave)), Max);
+	}
+	return Max;
+}
+
+FStateMachineBenchmark::FStateMachineBenchmark(UWorld& InWorld, const FStateMachineBenchmarkSettings& InSettings)
+	: World(InWorld), Settings(InSettings)
+{
+	Settings.NumMachines = FMath::Max(Settings.NumMachines, 1);
+	Settings.NumLoops = FMath::Max(Settings.NumLoops, 1);
+	Settings.MemorySampleInterval = FMath::Max(Settings.MemorySampleInterval, 1);
+}
+
+bool FStateMachineBenchmark::Run(const FStateMachineInputRecording& Recording)
+{
+	const UCharacterStateMachine* PlayerMachine = FindPlayerStateMachine(World);
+	if (Recording.GetFrames().IsEmpty() || PlayerMachine == nullptr)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("State machine benchmark needs a recording and a player character with a state machine to copy."));
+		return false;
+	}
+
+	SpawnMachines(*PlayerMachine->GetOwner());
+	Replay(Recording.GetFrames());
+	DestroyMachines();
+	return true;
+}
+
+void FStateMachineBenchmark::SpawnMachines(const AActor& Template)
+{
+	FActorSpawnParameters SpawnParameters;
+	SpawnParameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+	const int32 GridSize = FMath::CeilToInt32(FMath::Sqrt(static_cast<float>(Settings.NumMachines)));
+	Slots.Reset();
+	Slots.Reserve(Settings.NumMachines);
+
+	for (int32 Index = 0; Index < Settings.NumMachines; ++Index)
+	{
+		const FVector Offset((Index % GridSize + 1) * SpawnSpacing, (Index / GridSize + 1) * SpawnSpacing, 0);
+		AActor* Actor = World.SpawnActor<AActor>(Template.GetClass(), Template.GetActorLocation() + Offset, Template.GetActorRotation(), SpawnParameters);
+		UCharacterStateMachine* Machine = Actor != nullptr ? Actor->FindComponentByClass<UCharacterStateMachine>() : nullptr;
+		if (Machine == nullptr)
+		{
+			if (Actor != nullptr) Actor->Destroy();
+			continue;
+		}
+
+		//Enters are read back from the trace, so it has to be on even where the character turns it off.
+		if (!Machine->GetTraceRecorder().IsRecording()) Machine->GetTraceRecorder().Initialize(256);
+		//Nothing advances the world clock during the replay. In fixed timestep mode detection timers, time in state and air time
+		//count the time SimulateSteps simulates instead, and resetting starts them all over on that clock.
+		Machine->SetUseFixedTimestep(true);
+		Machine->ResetForReuse();
+		Machine->SetState(ECharacterState::DefaultState);
+
+		FMachineSlot& Slot = Slots.AddDefaulted_GetRef();
+		Slot.Machine = Machine;
+		Slot.Movement = Actor->FindComponentByClass<UCharacterMovementComponent>();
+		Slot.Phase = static_cast<int64>(Index) * 7919;
+		Slot.TraceIndex = Machine->GetTraceRecorder().GetWriteIndex();
+	}
+}
+
+void FStateMachineBenchmark::DestroyMachines()
+{
+	for (const FMachineSlot& Slot : Slots)
+	{
+		Slot.Machine->GetOwner()->Destroy();
+	}
+	Slots.Reset();
+}
+
+void FStateMachineBenchmark::Replay(const TArray<FStateMachineInputFrame>& Frames)
+{
+	NumFrames = static_cast<int64>(Frames.Num()) * Settings.NumLoops;
+	NumEnters = 0;
+	NumRequests = 0;
+	NumRejectedRequests = 0;
+	NumLostRequests = 0;
+	NumUnansweredRequests = 0;
+	NumLostRecords = 0;
+	SimulatedSeconds = 0;
+	LatencyMicroseconds.Reset();
+	LatencyFrames.Reset();
+	FrameMicroseconds.Reset();
+	MemorySamples.Reset();
+	MemorySamples.Reserve(NumFrames / Settings.MemorySampleInterval + 2);
+
+	//Everything the replay writes to is allocated above, so with -trace=memory,cpu,bookmark the allocations Insights shows between
+	//the bookmarks are the machines' and the engine's.
+	TRACE_BOOKMARK(TEXT("StateMachineBenchmark replay start"));
+	SampleMemory(0, 0);
+	const uint64 StartCycles = FPlatformTime::Cycles64();
+
+	for (int64 Frame = 0; Frame < NumFrames; ++Frame)
+	{
+		TRACE_CPUPROFILER_EVENT_SCOPE(StateMachineBenchmarkFrame);
+		const uint64 FrameStartCycles = FPlatformTime::Cycles64();
+
+		//Async traces the mechanics queue are run at the end of the frame and read back in the next one, the way a world tick does.
+		//Mechanics only read results submitted on the frame before, so the frame counter moves on too.
+		GFrameCounter++;
+		World.ResetAsyncTrace();
+		for (FMachineSlot& Slot : Slots)
+		{
+			ReplayFrame(Slot, Frames[(Frame + Slot.Phase) % Frames.Num()], Frame);
+		}
+		World.FinishAsyncTrace();
+
+		FrameMicroseconds.Add(FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - FrameStartCycles) * 1e6);
+		SimulatedSeconds += Frames[Frame % Frames.Num()].DeltaTime;
+
+		if ((Frame + 1) % Settings.MemorySampleInterval == 0 || Frame + 1 == NumFrames)
+		{
+			SampleMemory(Frame + 1, SimulatedSeconds);
+		}
+	}
+
+	WallSeconds = FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - StartCycles);
+	TRACE_BOOKMARK(TEXT("StateMachineBenchmark replay end"));
+
+	for (const FMachineSlot& Slot : Slots)
+	{
+		NumUnansweredRequests += FMath::CountBits(Slot.PendingRequests);
+	}
+}
+
+void FStateMachineBenchmark::ReplayFrame(FMachineSlot& Slot, const FStateMachineInputFrame& Input, const int64 Frame)
+{
+	UCharacterStateMachine& Machine = *Slot.Machine;
+	Slot.FrameStartCycles = FPlatformTime::Cycles64();
+
+	//World probes first, they are what detectors read. Nothing ticks the movement component during the replay, so they stick.
+	if (Slot.Movement != nullptr)
+	{
+		Slot.Movement->Velocity = FVector(Input.Velocity);
+		if ((Input.Grounded != 0) != Slot.Movement->IsMovingOnGround()) Slot.Movement->SetMovementMode(Input.Grounded != 0 ? MOVE_Walking : MOVE_Falling);
+	}
+	Machine.SetCustomPredicateInput(EStatePredicateInput::Custom0, Input.CustomPredicateInputs[0]);
+	Machine.SetCustomPredicateInput(EStatePredicateInput::Custom1, Input.CustomPredicateInputs[1]);
+	FVector2d MovementInput(Input.MovementInput);
+	Machine.OverrideMovementInput(MovementInput);
+
+	//Each request waits for the enter of its own state, see ReadTrace. Asking again for a state that is still waiting keeps the
+	//first request's time and is not counted twice, a single answer ends both.
+	for (uint64 Requests = Input.RequestedStates; Requests != 0; Requests &= Requests - 1)
+	{
+		const int32 State = FMath::CountTrailingZeros64(Requests);
+		if ((Slot.PendingRequests & uint64(1) << State) == 0)
+		{
+			Slot.RequestCycles[State] = Slot.GetMachineCycles(FPlatformTime::Cycles64());
+			Slot.RequestFrames[State] = Frame;
+			Slot.PendingRequests |= uint64(1) << State;
+			NumRequests++;
+		}
+		Machine.SetState(static_cast<ECharacterState>(State));
+	}
+
+	Machine.SimulateSteps(1, Input.DeltaTime);
+	const uint64 FrameEndCycles = FPlatformTime::Cycles64();
+	ReadTrace(Slot, Frame);
+	Slot.BusyCycles += FrameEndCycles - Slot.FrameStartCycles;
+}
+
+void FStateMachineBenchmark::ReadTrace(FMachineSlot& Slot, const int64 Frame)
+{
+	const FStateMachineTraceRecorder& Trace = Slot.Machine->GetTraceRecorder();
+	const uint64 End = Trace.GetWriteIndex();
+
+	//The ring wrapped past records not read yet. Whatever they held for the pending requests is gone, so those are counted as lost
+	//instead of waiting for an answer that never comes.
+	const uint64 Oldest = Trace.GetOldestIndex();
+	if (Slot.TraceIndex < Oldest)
+	{
+		NumLostRecords += Oldest - Slot.TraceIndex;
+		NumLostRequests += FMath::CountBits(Slot.PendingRequests);
+		Slot.PendingRequests = 0;
+		Slot.TraceIndex = Oldest;
+	}
+
+	FStateTraceRecord Record;
+	for (uint64 Index = Slot.TraceIndex; Index < End; ++Index)
+	{
+		if (!Trace.GetRecord(Index, Record)) continue;
+
+		if (Record.Type == EStateTraceEvent::Enter)
+		{
+			NumEnters++;
+			const uint64 StateBit = Record.From < NumCharacterStates ? uint64(1) << Record.From : 0;
+			if ((Slot.PendingRequests & StateBit) == 0) continue;
+
+			LatencyMicroseconds.Add(FPlatformTime::ToSeconds64(Slot.GetMachineCycles(Record.Timestamp) - Slot.RequestCycles[Record.From]) * 1e6);
+			LatencyFrames.Add(static_cast<double>(Frame - Slot.RequestFrames[Record.From]));
+			Slot.PendingRequests &= ~StateBit;
+		}
+		//A failed transition or a rejected queued request of a pending state ends its wait without an enter. Transition records
+		//of entered states come after their enter, which already paired them.
+		else if ((Record.Type == EStateTraceEvent::Transition && Record.Result != static_cast<uint8>(StateMachineCore::ESetStateResult::Entered))
+			|| Record.Type == EStateTraceEvent::RequestRejected)
+		{
+			const uint64 StateBit = Record.To < NumCharacterStates ? uint64(1) << Record.To : 0;
+			if ((Slot.PendingRequests & StateBit) == 0) continue;
+
+			NumRejectedRequests++;
+			Slot.PendingRequests &= ~StateBit;
+		}
+	}
+	Slot.TraceIndex = End;
+}
+
+void FStateMachineBenchmark::SampleMemory(const int64 Frame, const double InSimulatedSeconds)
+{
+	int64 MachineBytes = 0;
+	for (const FMachineSlot& Slot : Slots)
+	{
+		MachineBytes += Slot.Machine->GetResourceSizeBytes(EResourceSizeMode::Exclusive);
+		for (const FMechanicStateData& Mechanic : Slot.Machine->GetMechanics())
+		{
+			MachineBytes += Mechanic.Component->GetResourceSizeBytes(EResourceSizeMode::Exclusive);
+		}
+	}
+
+	MemorySamples.Add({ Frame, InSimulatedSeconds, FPlatformMemory::GetStats().UsedPhysical, MachineBytes });
+}
+
+bool FStateMachineBenchmark::WriteResults(const FString& FilePath, const FString& InputName) const
+{
+	//Whole rounds the percentiles, for values that can only be whole numbers, like frames.
+	const auto WriteHistogram = [](FString& Json, const TCHAR* Name, const FHistogram& Histogram, const bool Whole)
+	{
+		const auto Percentile = [&Histogram, Whole](const double Rank)
+		{
+			const double Value = Histogram.GetPercentile(Rank);
+			return Whole ? FMath::RoundToDouble(Value) : Value;
+		};
+		Json += FString::Printf(TEXT("\t\"%s\": {\"samples\": %llu, \"p50\": %.3f, \"p99\": %.3f, \"p999\": %.3f, \"max\": %.3f},\n"), Name,
+			Histogram.NumSamples, Percentile(0.5), Percentile(0.99), Percentile(0.999), Histogram.Max);
+	};
+
+	const int64 NumMachineFrames = NumFrames * Slots.Num();
+	const FMemorySample First = MemorySamples.IsEmpty() ? FMemorySample() : MemorySamples[0];
+	const FMemorySample Last = MemorySamples.IsEmpty() ? FMemorySample() : MemorySamples.Last();
+
+	FString Json = TEXT("{\n");
+	Json += FString::Printf(TEXT("\t\"version\": %u,\n"), ResultsVersion);
+	Json += FString::Printf(TEXT("\t\"build\": \"%s\",\n"), *FString(FApp::GetBuildVersion()).ReplaceCharWithEscapedChar());
+	Json += FString::Printf(TEXT("\t\"configuration\": \"%s\",\n"), LexToString(FApp::GetBuildConfiguration()));
+	Json += FString::Printf(TEXT("\t\"date\": \"%s\",\n"), *FDateTime::UtcNow().ToIso8601());
+	Json += FString::Printf(TEXT("\t\"input\": \"%s\",\n"), *InputName.ReplaceCharWithEscapedChar());
+	Json += FString::Printf(TEXT("\t\"machines\": %d,\n\t\"frames\": %lld,\n\t\"transitions\": %llu,\n"), Slots.Num(), NumFrames, NumEnters);
+	Json += FString::Printf(TEXT("\t\"requests\": %llu,\n\t\"rejected_requests\": %llu,\n"), NumRequests, NumRejectedRequests);
+	Json += FString::Printf(TEXT("\t\"lost_requests\": %llu,\n\t\"unanswered_requests\": %llu,\n\t\"lost_trace_records\": %llu,\n"),
+		NumLostRequests, NumUnansweredRequests, NumLostRecords);
+	Json += FString::Printf(TEXT("\t\"simulated_seconds\": %.3f,\n\t\"wall_seconds\": %.3f,\n"), SimulatedSeconds, WallSeconds);
+	Json += FString::Printf(TEXT("\t\"throughput\": {\"machine_frames_per_second\": %.1f, \"frames_per_second\": %.1f},\n"),
+		WallSeconds > 0 ? NumMachineFrames / WallSeconds : 0, WallSeconds > 0 ? NumFrames / WallSeconds : 0);
+	WriteHistogram(Json, TEXT("frame_time_us"), FrameMicroseconds, false);
+	WriteHistogram(Json, TEXT("latency_us"), LatencyMicroseconds, false);
+	WriteHistogram(Json, TEXT("latency_frames"), LatencyFrames, true);
+	Json += FString::Printf(TEXT("\t\"memory_growth\": {\"used_physical_bytes\": %lld, \"machine_bytes\": %lld},\n"),
+		static_cast<int64>(Last.UsedPhysical) - static_cast<int64>(First.UsedPhysical), Last.MachineBytes - First.MachineBytes);
+
+	Json += TEXT("\t\"memory\": [\n");
+	for (int32 Index = 0; Index < MemorySamples.Num(); ++Index)
+	{
+		const FMemorySample& Sample = MemorySamples[Index];
+		Json += FString::Printf(TEXT("\t\t{\"frame\": %lld, \"simulated_seconds\": %.3f, \"used_physical_bytes\": %llu, \"machine_bytes\": %lld}%s\n"),
+			Sample.Frame, Sample.SimulatedSeconds, Sample.UsedPhysical, Sample.MachineBytes,
+			Index + 1 < MemorySamples.Num() ? TEXT(",") : TEXT(""));
+	}
+	Json += TEXT("\t]\n}\n");
+
+	return FFileHelper::SaveStringToFile(Json, *FilePath);
+}
+
+#pragma endregion
+
+#pragma region Micro Benchmarks
+
+FStateMachineMicroBenchmark::FStateMachineMicroBenchmark(const TCHAR* InName, const int32 InIterations)
+	: Name(InName), Iterations(FMath::Max(InIterations, 1))
+{
+}
+
+double FStateMachineMicroBenchmark::AddCase(const TCHAR* CaseName, const double NanosecondsPerCall)
+{
+	Cases.Add({ CaseName, NanosecondsPerCall });
+	return NanosecondsPerCall;
+}
+
+bool FStateMachineMicroBenchmark::WriteResults(const FString& FilePath) const
+{
+	FString Json = TEXT("{\n");
+	Json += FString::Printf(TEXT("\t\"version\": %u,\n"), ResultsVersion);
+	Json += FString::Printf(TEXT("\t\"benchmark\": \"%s\",\n"), *Name);
+	Json += FString::Printf(TEXT("\t\"configuration\": \"%s\",\n"), LexToString(FApp::GetBuildConfiguration()));
+	Json += FString::Printf(TEXT("\t\"date\": \"%s\",\n"), *FDateTime::UtcNow().ToIso8601());
+	Json += FString::Printf(TEXT("\t\"iterations\": %d,\n"), Iterations);
+	Json += TEXT("\t\"cases\": [\n");
+	for (int32 Index = 0; Index < Cases.Num(); ++Index)
+	{
+		const FCase& Case = Cases[Index];
+		UE_LOG(LogTemp, Log, TEXT("%s: %-40s %10.2f ns"), *Name, *Case.Name, Case.NanosecondsPerCall);
+		Json += FString::Printf(TEXT("\t\t{\"name\": \"%s\", \"ns_per_call\": %.3f}%s\n"), *Case.Name, Case.NanosecondsPerCall,
+			Index + 1 < Cases.Num() ? TEXT(",") : TEXT(""));
+	}
+	Json += TEXT("\t]\n}\n");
+
+	const FString ResolvedPath = ResolveBenchmarkPath(FilePath);
+	if (!FFileHelper::SaveStringToFile(Json, *ResolvedPath)) return false;
+
+	UE_LOG(LogTemp, Log, TEXT("%s benchmark results written to %s"), *Name, *ResolvedPath);
+	return true;
+}
+
+#pragma endregion
+
+namespace
+{
+	//Recording in progress, driven by the world's post actor tick.
+	FStateMachineInputRecording ActiveRecording;
+	TWeakObjectPtr<UCharacterStateMachine> RecordedMachine;
+	FDelegateHandle RecordingHandle;
+	FString RecordingPath;
+	double RecordingEndTime = 0;
+
+	void StopRecording()
+	{
+		FWorldDelegates::OnWorldPostActorTick.Remove(RecordingHandle);
+		RecordingHandle.Reset();
+		RecordedMachine.Reset();
+
+		if (ActiveRecording.GetFrames().IsEmpty()) return;
+		if (ActiveRecording.SaveToFile(RecordingPath))
+		{
+			UE_LOG(LogTemp, Log, TEXT("Recorded %d frames of state machine input to %s"), ActiveRecording.GetFrames().Num(), *RecordingPath);
+		}
+		ActiveRecording.Reset();
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs StateMachineRecordInputCommand(
+	TEXT("StateMachine.RecordInput"),
+	TEXT("Records the local player's state machine input and world probes for StateMachine.Benchmark. Arguments: seconds, 60 by default, ")
+	TEXT("and the file, relative to Saved/StateMachineBenchmarks. Run it again to stop early."),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		if (RecordingHandle.IsValid())
+		{
+			StopRecording();
+			return;
+		}
+
+		UCharacterStateMachine* Machine = FindPlayerStateMachine(*World);
+		if (Machine == nullptr)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("No player character with a state machine to record."));
+			return;
+		}
+
+		const double Seconds = Args.IsEmpty() ? 60 : FMath::Max(FCString::Atod(*Args[0]), 1.0);
+		RecordingPath = ResolveBenchmarkPath(Args.Num() > 1 ? Args[1] : FString::Printf(TEXT("%s.sminput"), *FDateTime::Now().ToString()));
+		RecordingEndTime = World->GetTimeSeconds() + Seconds;
+		RecordedMachine = Machine;
+		//Requests made before the recording started are not part of it.
+		Machine->ConsumeExternalRequests();
+
+		RecordingHandle = FWorldDelegates::OnWorldPostActorTick.AddLambda([World](UWorld* TickedWorld, ELevelTick, const float DeltaTime)
+		{
+			if (TickedWorld != World) return;
+
+			UCharacterStateMachine* Recorded = RecordedMachine.Get();
+			if (Recorded == nullptr || TickedWorld->GetTimeSeconds() >= RecordingEndTime)
+			{
+				StopRecording();
+				return;
+			}
+			ActiveRecording.CaptureFrame(*Recorded, DeltaTime);
+		});
+	}));
+
+static FAutoConsoleCommandWithWorldAndArgs StateMachineBenchmarkCommand(
+	TEXT("StateMachine.Benchmark"),
+	TEXT("Replays a StateMachine.RecordInput file into copies of the player's character and writes throughput, latency ")
+	TEXT("and memory growth to Saved/StateMachineBenchmarks as JSON. Arguments: the input file, the number of machines, 100 by default, ")
+	TEXT("the number of loops, 1 by default, and the output file."),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		if (Args.IsEmpty())
+		{
+			UE_LOG(LogTemp, Warning, TEXT("StateMachine.Benchmark needs an input file."));
+			return;
+		}
+
+		FStateMachineInputRecording Recording;
+		const FString InputPath = ResolveBenchmarkPath(Args[0]);
+		if (!Recording.LoadFromFile(InputPath))
+		{
+			UE_LOG(LogTemp, Warning, TEXT("%s is not a state machine input recording of this version."), *InputPath);
+			return;
+		}
+
+		FStateMachineBenchmarkSettings Settings;
+		if (Args.Num() > 1) Settings.NumMachines = FCString::Atoi(*Args[1]);
+		if (Args.Num() > 2) Settings.NumLoops = FCString::Atoi(*Args[2]);
+
+		FStateMachineBenchmark Benchmark(*World, Settings);
+		if (!Benchmark.Run(Recording)) return;
+
+		const FString OutputPath = ResolveBenchmarkPath(Args.Num() > 3 ? Args[3] : FString::Printf(TEXT("Benchmark_%s.json"), *FDateTime::Now().ToString()));
+		if (Benchmark.WriteResults(OutputPath, FPaths::GetCleanFilename(InputPath)))
+		{
+			UE_LOG(LogTemp, Log, TEXT("State machine benchmark results written to %s"), *OutputPath);
+		}
+	}));
+
+namespace
+{
+	//Arguments of the micro benchmark commands: iterations, then the output file.
+	int32 GetMicroBenchmarkIterations(const TArray<FString>& Args, const int32 Default)
+	{
+		return Args.IsEmpty() ? Default : FCString::Atoi(*Args[0]);
+	}
+
+	FString GetMicroBenchmarkOutput(const TArray<FString>& Args, const TCHAR* Name)
+	{
+		return Args.Num() > 1 ? Args[1] : FString::Printf(TEXT("%s_%s.json"), Name, *FDateTime::Now().ToString());
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs StateMachineDelegateBenchmarkCommand(
+	TEXT("StateMachine.Benchmark.Delegates"),
+	TEXT("Times a mechanic's state events: the dynamic Blueprint delegate, unbound and with a listener, against the native hook and the ")
+	TEXT("bound checks every update does now. Arguments: iterations, 1000000 by default, and the output file."),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld*)
+	{
+		FStateMachineMicroBenchmark Benchmark(TEXT("Delegates"), GetMicroBenchmarkIterations(Args, 1000000));
+
+		const TStrongObjectPtr<UStateMachineBenchmarkListener> Listener(NewObject<UStateMachineBenchmarkListener>());
+		FStateMachineBenchmarkEvent Unbound;
+		FStateMachineBenchmarkEvent Blueprint;
+		Blueprint.AddDynamic(Listener.Get(), &UStateMachineBenchmarkListener::OnStateEvent);
+		FOnStateNativeEvent UnboundNative;
+		FOnStateNativeEvent Native;
+		int64 NativeCalls = 0;
+		Native.AddLambda([&NativeCalls](UStateComponentBase&) { NativeCalls++; });
+
+		//Broadcast only reads the component reference it passes on, the default object stands in for a mechanic.
+		UStateComponentBase& Component = *GetMutableDefault<UStateComponentBase>();
+		bool BroadcastBlueprintEvents = false;
+
+		//What every OnUpdateState paid before the events were opt-in, and what it pays now with nothing listening.
+		Benchmark.Measure(TEXT("dynamic_unbound_broadcast"), [&Unbound]() { Unbound.Broadcast(); });
+		Benchmark.Measure(TEXT("guarded_unbound"), [&]()
+		{
+			if (BroadcastBlueprintEvents && Unbound.IsBound()) Unbound.Broadcast();
+			if (UnboundNative.IsBound()) UnboundNative.Broadcast(Component);
+		});
+		//One listener, Blueprint against C++.
+		Benchmark.Measure(TEXT("dynamic_one_listener"), [&Blueprint]() { Blueprint.Broadcast(); });
+		Benchmark.Measure(TEXT("native_one_listener"), [&Native, &Component]() { Native.Broadcast(Component); });
+
+		UE_LOG(LogTemp, Verbose, TEXT("Delegate benchmark calls: %lld dynamic, %lld native"), Listener->NumCalls, NativeCalls);
+		Benchmark.WriteResults(GetMicroBenchmarkOutput(Args, TEXT("Delegates")));
+	}));
+
+static FAutoConsoleCommandWithWorldAndArgs StateMachineSpawnBenchmarkCommand(
+	TEXT("StateMachine.Benchmark.Spawn"),
+	TEXT("Times getting a state machine character ready: spawning and destroying a copy of the player's character, setting up its machine ")
+	TEXT("again, resetting it for reuse from a pool, and the by-name mechanic lookups setup did before it cached them per class. ")
+	TEXT("Arguments: iterations, 1000 by default, and the output file."),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		const UCharacterStateMachine* PlayerMachine = FindPlayerStateMachine(*World);
+		if (PlayerMachine == nullptr)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("StateMachine.Benchmark.Spawn needs a player character with a state machine to copy."));
+			return;
+		}
+
+		FStateMachineMicroBenchmark Benchmark(TEXT("Spawn"), GetMicroBenchmarkIterations(Args, 1000));
+		const AActor& Template = *PlayerMachine->GetOwner();
+		FActorSpawnParameters SpawnParameters;
+		SpawnParameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+		//Spawning is not repeated in batches, every copy stays around until they are all destroyed, like a wave of enemies.
+		TArray<AActor*> Copies;
+		Copies.Reserve(Benchmark.GetIterations());
+		uint64 StartCycles = FPlatformTime::Cycles64();
+		for (int32 Index = 0; Index < Benchmark.GetIterations(); ++Index)
+		{
+			const FVector Offset((Index % 32 + 1) * SpawnSpacing, (Index / 32 + 1) * SpawnSpacing, 0);
+			Copies.Add(World->SpawnActor<AActor>(Template.GetClass(), Template.GetActorLocation() + Offset, Template.GetActorRotation(), SpawnParameters));
+		}
+		Benchmark.AddCase(TEXT("spawn_actor"), FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - StartCycles) * 1e9 / Copies.Num());
+
+		UCharacterStateMachine* Machine = nullptr;
+		for (const AActor* Copy : Copies)
+		{
+			Machine = Copy != nullptr ? Copy->FindComponentByClass<UCharacterStateMachine>() : nullptr;
+			if (Machine != nullptr) break;
+		}
+
+		if (Machine != nullptr)
+		{
+			Benchmark.Measure(TEXT("setup_state_machine"), [Machine]() { Machine->SetupStateMachine(); });
+			Benchmark.Measure(TEXT("reset_for_reuse"), [Machine]()
+			{
+				Machine->ResetForReuse();
+				Machine->SetState(ECharacterState::DefaultState);
+			});
+
+			//What finding the mechanics cost per setup before the per-class cache, a component reference lookup by name for each.
+			AActor* Owner = Machine->GetOwner();
+			const UEnum* StateEnum = StaticEnum<ECharacterState>();
+			TArray<ECharacterState> States;
+			for (const FMechanicStateData& Mechanic : Machine->GetMechanics()) States.Add(Mechanic.State);
+			Benchmark.Measure(TEXT("name_lookups_per_setup"), [Owner, StateEnum, &States]()
+			{
+				for (const ECharacterState State : States)
+				{
+					FComponentReference Reference;
+					Reference.PathToComponent = StateEnum->GetNameStringByValue(static_cast<int64>(State));
+					Reference.GetComponent(Owner);
+				}
+			});
+			Machine->SetState(ECharacterState::DefaultState);
+		}
+
+		StartCycles = FPlatformTime::Cycles64();
+		for (AActor* Copy : Copies)
+		{
+			if (Copy != nullptr) Copy->Destroy();
+		}
+		Benchmark.AddCase(TEXT("destroy_actor"), FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - StartCycles) * 1e9 / FMath::Max(Copies.Num(), 1));
+
+		Benchmark.WriteResults(GetMicroBenchmarkOutput(Args, TEXT("Spawn")));
+	}));
@@ -0,0 +1,221 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+//Input-to-state latency and soak benchmark.
+//StateMachine.RecordInput captures what the local player did, and what the world reported to their detectors, once per frame.
+//StateMachine.Benchmark spawns copies of the player's character and replays the recording into all of them. It runs back to back,
+//without rendering and without waiting for real time, then writes the results as JSON. Tools/CompareStateMachineBenchmarks.py
+//compares two of those. A headless run:
+//	UnrealEditor-Cmd <Project> <Map> -game -nullrhi -unattended -ExecCmds="StateMachine.Benchmark Run.sminput 500 60, quit"
+//Allocations during the replay are left to Unreal Insights, add -trace=memory,cpu,bookmark to the run.
+//
+//The StateMachine.Benchmark.* commands are micro benchmarks of single paths, see FStateMachineMicroBenchmark.
+
+#include "CoreMinimal.h"
+#include "CharacterStateMachine.h"
+#include "StateMachineBenchmark.generated.h"
+
+class UCharacterMovementComponent;
+
+//One recorded frame of a machine's inputs. Written as-is into the recording file.
+struct FStateMachineInputFrame
+{
+	//States gameplay code asked for this frame, see UCharacterStateMachine::ConsumeExternalRequests.
+	uint64 RequestedStates;
+	//World probes, what the owner's movement reported.
+	FVector3f Velocity;
+	FVector2f MovementInput;
+	float DeltaTime;
+	float CustomPredicateInputs[2];
+	uint8 Grounded;
+	uint8 Padding[7];
+};
+static_assert(sizeof(FStateMachineInputFrame) == 48, "FStateMachineInputFrame is part of the recording file format, keep it at 48 bytes.");
+
+//Frames captured from a live machine, saved to and loaded from a compact binary file.
+class CHASING_5SD073_API FStateMachineInputRecording
+{
+public:
+	void Reset() { Frames.Reset(); }
+
+	//Appends a frame with the machine's current inputs. Call once per frame after actors ticked, so the frame's requests are in.
+	void CaptureFrame(UCharacterStateMachine& Machine, const float DeltaTime);
+
+	const TArray<FStateMachineInputFrame>& GetFrames() const { return Frames; }
+
+	bool SaveToFile(const FString& FilePath) const;
+	bool LoadFromFile(const FString& FilePath);
+
+private:
+	TArray<FStateMachineInputFrame> Frames;
+};
+
+struct FStateMachineBenchmarkSettings
+{
+	int32 NumMachines = 100;
+	//Times the recording is played back to back. Soak runs loop a short recording for as long as they need to.
+	int32 NumLoops = 1;
+	//Frames between memory samples.
+	int32 MemorySampleInterval = 600;
+};
+
+//Replays a recording into NumMachines copies of the player's character and measures:
+//- throughput, machine frames replayed per second of wall time
+//- latency from each recorded state request to the OnEnterState of that state, in frames and in microseconds of that machine's
+//  own replay, so the other machines replayed in between do not count. Rejected requests are counted but not timed, and so are
+//  requests whose answer the trace ring overwrote before it was read.
+//- allocations, in Insights between the replay bookmarks, each replayed frame is a StateMachineBenchmarkFrame scope
+//- memory growth, process and machines, sampled every MemorySampleInterval frames
+//Each copy starts at a different frame of the recording, so they do not all switch state on the same frame. The world clock stands
+//still during the replay, so the copies run in fixed timestep mode and their timers count the simulated time instead.
+class CHASING_5SD073_API FStateMachineBenchmark
+{
+public:
+	FStateMachineBenchmark(UWorld& InWorld, const FStateMachineBenchmarkSettings& InSettings);
+
+	//Spawns the copies, replays into them and destroys them again. Returns false without running if the recording is empty or
+	//there is no player character with a state machine to copy.
+	bool Run(const FStateMachineInputRecording& Recording);
+
+	//Writes the results of the last run as JSON. InputName is recorded with them, to tell runs apart.
+	bool WriteResults(const FString& FilePath, const FString& InputName) const;
+
+private:
+	struct FMachineSlot
+	{
+		UCharacterStateMachine* Machine = nullptr;
+		UCharacterMovementComponent* Movement = nullptr;
+		//Frame of the recording this machine starts at.
+		int64 Phase = 0;
+		//Next trace record to look at for enters.
+		uint64 TraceIndex = 0;
+		//Cycles spent replaying this machine in earlier frames, and when its current frame started.
+		uint64 BusyCycles = 0;
+		uint64 FrameStartCycles = 0;
+		//Requested states without an enter or a rejection yet, and the machine cycles and frame each of them was requested at.
+		uint64 PendingRequests = 0;
+		uint64 RequestCycles[NumCharacterStates] = {};
+		int64 RequestFrames[NumCharacterStates] = {};
+
+		//Cycles spent replaying this machine up to Cycles, a time during its current frame.
+		uint64 GetMachineCycles(const uint64 Cycles) const { return BusyCycles + (FMath::Max(Cycles, FrameStartCycles) - FrameStartCycles); }
+	};
+
+	struct FMemorySample
+	{
+		int64 Frame;
+		double SimulatedSeconds;
+		uint64 UsedPhysical;
+		int64 MachineBytes;
+	};
+
+	//Log scaled histogram, so millions of samples fit in a fixed block that is allocated before the replay starts.
+	//Values come back as the lower edge of their bucket, within about 4.5% of the real value.
+	struct FHistogram
+	{
+		static constexpr int32 NumBuckets = 512;
+		static constexpr int32 BucketsPerOctave = 16;
+		static constexpr double MinValue = 0.1;
+
+		TArray<uint64> Buckets;
+		uint64 NumSamples = 0;
+		double Max = 0;
+
+		void Reset();
+		void Add(const double Value);
+		double GetPercentile(const double Percentile) const;
+	};
+
+	void SpawnMachines(const AActor& Template);
+	void DestroyMachines();
+	void Replay(const TArray<FStateMachineInputFrame>& Frames);
+	void ReplayFrame(FMachineSlot& Slot, const FStateMachineInputFrame& Input, const int64 Frame);
+	//Looks through the machine's trace records since the last frame for the enters and rejections of its pending requests.
+	void ReadTrace(FMachineSlot& Slot, const int64 Frame);
+	void SampleMemory(const int64 Frame, const double SimulatedSeconds);
+
+	UWorld& World;
+	FStateMachineBenchmarkSettings Settings;
+
+	TArray<FMachineSlot> Slots;
+
+	FHistogram LatencyMicroseconds;
+	FHistogram LatencyFrames;
+	FHistogram FrameMicroseconds;
+	TArray<FMemorySample> MemorySamples;
+
+	int64 NumFrames = 0;
+	uint64 NumEnters = 0;
+	uint64 NumRequests = 0;
+	uint64 NumRejectedRequests = 0;
+	//Requests whose enter or rejection was overwritten in the trace before it was read, and ones still waiting when the replay
+	//ended. With the timed and the rejected ones they add up to NumRequests.
+	uint64 NumLostRequests = 0;
+	uint64 NumUnansweredRequests = 0;
+	uint64 NumLostRecords = 0;
+	double SimulatedSeconds = 0;
+	double WallSeconds = 0;
+};
+
+//Times single code paths against each other, the old and the new way of doing one thing. Each case runs its function Iterations
+//times in a few batches and keeps the fastest batch, so a hitch in one of them does not count. Results are logged and written as JSON.
+class CHASING_5SD073_API FStateMachineMicroBenchmark
+{
+public:
+	FStateMachineMicroBenchmark(const TCHAR* InName, const int32 InIterations);
+
+	//Runs Function Iterations times per batch and records the fastest batch as nanoseconds per call.
+	template <typename FunctionType>
+	double Measure(const TCHAR* CaseName, FunctionType&& Function)
+	{
+		double Fastest = TNumericLimits<double>::Max();
+		for (int32 Batch = 0; Batch < NumBatches; ++Batch)
+		{
+			const uint64 StartCycles = FPlatformTime::Cycles64();
+			for (int32 Iteration = 0; Iteration < Iterations; ++Iteration)
+			{
+				Function();
+			}
+			Fastest = FMath::Min(Fastest, FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - StartCycles) * 1e9 / Iterations);
+		}
+		return AddCase(CaseName, Fastest);
+	}
+
+	//Records a case measured some other way, for timings that cannot be repeated in a loop, like spawning.
+	double AddCase(const TCHAR* CaseName, const double NanosecondsPerCall);
+
+	int32 GetIterations() const { return Iterations; }
+
+	//Logs every case and writes them to FilePath. Relative paths are taken from Saved/StateMachineBenchmarks.
+	bool WriteResults(const FString& FilePath) const;
+
+private:
+	static constexpr int32 NumBatches = 5;
+
+	struct FCase
+	{
+		FString Name;
+		double NanosecondsPerCall;
+	};
+
+	FString Name;
+	int32 Iterations;
+	TArray<FCase> Cases;
+};
+
+//Same signature as the mechanics' On Enter, On Update and On Exit events.
+DECLARE_DYNAMIC_MULTICAST_DELEGATE(FStateMachineBenchmarkEvent);
+
+//Something with a UFUNCTION for the delegate benchmark to bind to, what a Blueprint listener is to the dynamic delegates.
+UCLASS(Transient)
+class CHASING_5SD073_API UStateMachineBenchmarkListener : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	UFUNCTION()
+	void OnStateEvent() { NumCalls++; }
+
+	int64 NumCalls = 0;
+};
@@ -0,0 +1,115 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "StateMachineConfig.h"
+#include "StateComponentBase.h"
+
+#if WITH_EDITOR
+#include "Engine/BlueprintGeneratedClass.h"
+#include "Engine/SCS_Node.h"
+#include "Engine/SimpleConstructionScript.h"
+#include "Misc/DataValidation.h"
+#include "UObject/ObjectSaveContext.h"
+#endif
+
+bool UStateMachineConfig::LoadCompiled(FStateMachineCompiledConfig& OutCompiled) const
+{
+	if (CompiledData.Num() != sizeof(FStateMachineCompiledConfig)) return false;
+
+	FMemory::Memcpy(&OutCompiled, CompiledData.GetData(), sizeof(FStateMachineCompiledConfig));
+	return OutCompiled.Version == FStateMachineCompiledConfig::CurrentVersion && OutCompiled.Size == sizeof(FStateMachineCompiledConfig);
+}
+
+#if WITH_EDITOR
+namespace
+{
+	//Template of the mechanic named Name on OwnerClass. Native components are on the class default object, Blueprint ones in the
+	//construction script of the class or one of its Blueprint parents.
+	const UStateComponentBase* FindMechanicTemplate(UClass& OwnerClass, const FName Name)
+	{
+		if (const FObjectPropertyBase* Property = FindFProperty<FObjectPropertyBase>(&OwnerClass, Name))
+		{
+			if (const UStateComponentBase* Native = Cast<UStateComponentBase>(Property->GetObjectPropertyValue_InContainer(OwnerClass.GetDefaultObject())))
+			{
+				return Native;
+			}
+		}
+
+		UBlueprintGeneratedClass* ActualClass = Cast<UBlueprintGeneratedClass>(&OwnerClass);
+		for (const UBlueprintGeneratedClass* Class = ActualClass; Class != nullptr; Class = Cast<UBlueprintGeneratedClass>(Class->GetSuperClass()))
+		{
+			const USCS_Node* Node = Class->SimpleConstructionScript != nullptr ? Class->SimpleConstructionScript->FindSCSNode(Name) : nullptr;
+			if (Node != nullptr) return Cast<UStateComponentBase>(Node->GetActualComponentTemplate(ActualClass));
+		}
+		return nullptr;
+	}
+}
+
+bool UStateMachineConfig::Compile(TArray<uint8>& OutData, TArray<FText>& OutErrors) const
+{
+	OutData.Reset();
+	const int32 NumErrorsBefore = OutErrors.Num();
+	UCharacterStateMachine::ValidateHierarchy(MechanicsHierarchy, Regions, OutErrors);
+
+	UClass* Owner = OwnerClass.LoadSynchronous();
+	if (Owner == nullptr)
+	{
+		OutErrors.Add(FText::FromString(TEXT("Owner Class is not set.")));
+		return false;
+	}
+
+	//Compiled straight into zeroed bytes, so padding is always zero and the same config always saves the same bytes.
+	OutData.SetNumZeroed(sizeof(FStateMachineCompiledConfig));
+	FStateMachineCompiledConfig& Compiled = *new (OutData.GetData()) FStateMachineCompiledConfig();
+
+	FStateMechanicSettings Settings;
+	const UEnum* StateEnum = StaticEnum<ECharacterState>();
+	UCharacterStateMachine::BuildDefinition(Compiled.Definition, MechanicsHierarchy, Regions,
+		[Owner, StateEnum, &Settings, &OutErrors](const ECharacterState State) -> const FStateMechanicSettings*
+		{
+			const FString Name = StateEnum->GetNameStringByIndex(static_cast<int32>(State));
+			const UStateComponentBase* Template = FindMechanicTemplate(*Owner, FName(*Name));
+			if (Template == nullptr)
+			{
+				OutErrors.Add(FText::FromString(FString::Printf(TEXT("%s has no mechanic named %s."), *Owner->GetName(), *Name)));
+				return nullptr;
+			}
+
+			Settings = Template->BuildSettings();
+			return &Settings;
+		});
+
+	if (OutErrors.Num() == NumErrorsBefore) return true;
+
+	OutData.Reset();
+	return false;
+}
+
+void UStateMachineConfig::PreSave(FObjectPreSaveContext ObjectSaveContext)
+{
+	Super::PreSave(ObjectSaveContext);
+
+	TArray<FText> Errors;
+	if (Compile(CompiledData, Errors)) return;
+
+	//An error fails the cook, so a broken config cannot ship. In the editor the asset still saves, without compiled data.
+	for (const FText& Error : Errors)
+	{
+		UE_LOG(LogTemp, Error, TEXT("State machine config %s: %s"), *GetPathName(), *Error.ToString());
+	}
+}
+
+EDataValidationResult UStateMachineConfig::IsDataValid(FDataValidationContext& Context) const
+{
+	EDataValidationResult Result = Super::IsDataValid(Context);
+
+	TArray<uint8> Data;
+	TArray<FText> Errors;
+	if (!Compile(Data, Errors))
+	{
+		for (const FText& Error : Errors) Context.AddError(Error);
+		Result = EDataValidationResult::Invalid;
+	}
+	return Result;
+}
+#endif
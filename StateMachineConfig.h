@@ -0,0 +1,60 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "CharacterStateMachine.h"
+#include "Engine/DataAsset.h"
+#include "StateMachineConfig.generated.h"
+
+//What UStateMachineConfig compiles to. Stored as raw bytes in the asset and copied out with a single memcpy at setup.
+struct FStateMachineCompiledConfig
+{
+	//Bump when anything the definition is compiled from changes meaning, so stale assets are caught instead of misread.
+	static constexpr uint32 CurrentVersion = 1;
+
+	uint32 Version = CurrentVersion;
+	//Layout check on top of the version, catches a changed state count or region limit.
+	uint32 Size = sizeof(FStateMachineCompiledConfig);
+	//Mechanics are in Definition.PriorityOrder, which is also the order they end up in MechanicsList.
+	FCharacterStateMachineDefinition Definition;
+};
+static_assert(std::is_trivially_copyable_v<FStateMachineCompiledConfig>, "Compiled configs are copied as raw bytes.");
+
+//Hierarchy, regions and transitions of a character's state machine, validated and compiled in the editor instead of at every spawn.
+//Saving compiles it against the mechanics on OwnerClass. A broken config fails data validation, and fails the cook with an error,
+//so it never gets as far as play. Point UCharacterStateMachine::Config at it.
+//The transitions and guards come from the mechanic templates on OwnerClass when it is saved. Changing them on a placed instance
+//has no effect, and changing the templates needs a save of the config.
+UCLASS(BlueprintType)
+class CHASING_5SD073_API UStateMachineConfig : public UDataAsset
+{
+	GENERATED_BODY()
+
+public:
+	//Copies the compiled config into OutCompiled. Returns false if there is none, or it was compiled by a different version.
+	bool LoadCompiled(FStateMachineCompiledConfig& OutCompiled) const;
+
+#if WITH_EDITOR
+	virtual void PreSave(FObjectPreSaveContext ObjectSaveContext) override;
+	virtual EDataValidationResult IsDataValid(FDataValidationContext& Context) const override;
+
+	//Validates the config and compiles it into OutData. Returns false with the reasons in OutErrors if it is broken.
+	bool Compile(TArray<uint8>& OutData, TArray<FText>& OutErrors) const;
+#endif
+
+	UPROPERTY(EditAnywhere, Category = "Character State Machine",
+		meta = (ToolTip = "Character the config is for. Its mechanics, named after their state, are checked and their transitions compiled on save."))
+	TSoftClassPtr<AActor> OwnerClass;
+
+	UPROPERTY(EditAnywhere, Category = "Character State Machine")
+	TArray<ECharacterState> MechanicsHierarchy;
+
+	UPROPERTY(EditAnywhere, Category = "Character State Machine",
+		meta = (ToolTip = "Extra layers of states with their own current state, sharing this machine's transition table, update and detection. A state can only be in one of them."))
+	TArray<FStateMachineRegion> Regions;
+
+private:
+	UPROPERTY()
+	TArray<uint8> CompiledData;
+};
@@ -0,0 +1,588 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+//Engine-free core of the character state machine. Everything here is plain C++ with no Unreal includes, so the transition,
+//dispatch and detection logic can be built and profiled on its own, outside of the engine.
+//UCharacterStateMachine wraps TStateMachineCore<ECharacterState, UStateComponentBase, ...> and adds the Unreal side on top
+//(component lookup, debug text, batching, traces).
+//
+//States are split into regions, each with its own current state. Region 0 is the main one, the others are orthogonal layers
+//(upper body actions next to locomotion) or sub-states that only run while a parent state is active. All regions share one
+//transition table, one update pass and one detection pass.
+//
+//What a machine is made of, its bindings, regions, guards and transition table, is a TStateMachineDefinition. It is built once and
+//can be shared by every machine set up the same way. The machine itself only keeps its current states and its state pointers.
+//
+//StateType is whatever the states are. SetState and Update call these on it, with the context passed in:
+//	bool OnSetStateConditionCheck(ContextType&)
+//	void OnEnterState(ContextType&)
+//	void OnUpdateState(ContextType&)
+//	void OnUpdateState(ContextType&, float DeltaTime), only if Step is used
+//	void OnExitState(ContextType&)
+
+#include <cstdint>
+
+namespace StateMachineCore
+{
+	template <typename EnumType>
+	constexpr uint64_t StateBit(const EnumType State)
+	{
+		return uint64_t(1) << static_cast<uint8_t>(State);
+	}
+
+	//Dense NxN bit matrix. Each row is the state being entered, each bit in it is a state it can be entered from.
+	//Everything is constexpr, so a fixed table can be built at compile time, see StaticStateMachine.h.
+	template <typename EnumType, int NumStates>
+	struct TTransitionTable
+	{
+		static_assert(NumStates <= 64, "TTransitionTable stores one uint64 row per state, widen the rows before adding more states.");
+
+		//Every state set. A plain shift by NumStates is undefined once the enum fills all 64 bits.
+		static constexpr uint64_t AllStatesMask = NumStates == 64 ? ~uint64_t(0) : (uint64_t(1) << NumStates) - 1;
+
+		uint64_t Rows[NumStates] = {};
+
+		//Transposed copy of Rows. Each entry is the mask of states that can be entered from that state.
+		uint64_t Columns[NumStates] = {};
+
+		constexpr bool CanTransition(const EnumType From, const EnumType To) const
+		{
+			return (Rows[static_cast<uint8_t>(To)] >> static_cast<uint8_t>(From)) & 1;
+		}
+
+		constexpr uint64_t GetEnterableMask(const EnumType From) const
+		{
+			return Columns[static_cast<uint8_t>(From)];
+		}
+
+		constexpr void Allow(const EnumType From, const EnumType To)
+		{
+			Rows[static_cast<uint8_t>(To)] |= StateBit(From);
+			Columns[static_cast<uint8_t>(From)] |= StateBit(To);
+		}
+
+		constexpr void Reset()
+		{
+			for (int Index = 0; Index < NumStates; ++Index)
+			{
+				Rows[Index] = 0;
+				Columns[Index] = 0;
+			}
+		}
+
+		constexpr bool operator==(const TTransitionTable& Other) const
+		{
+			for (int Index = 0; Index < NumStates; ++Index)
+			{
+				if (Rows[Index] != Other.Rows[Index]) return false;
+			}
+			return true;
+		}
+	};
+
+	//Per-run detection counters of a single machine, reset every time detection runs.
+	struct FDetectionStats
+	{
+		//Detectors that were actually called.
+		int32_t Evaluated = 0;
+		//Detectors skipped because the transition from the current state is statically disallowed.
+		int32_t SkippedDisallowed = 0;
+		//Lower priority detectors skipped because a higher priority one already switched state.
+		int32_t SkippedAfterTransition = 0;
+		//Detectors skipped because nothing their detection depends on changed since they last ran.
+		int32_t SkippedUnchanged = 0;
+
+		FDetectionStats& operator+=(const FDetectionStats& Other)
+		{
+			Evaluated += Other.Evaluated;
+			SkippedDisallowed += Other.SkippedDisallowed;
+			SkippedAfterTransition += Other.SkippedAfterTransition;
+			SkippedUnchanged += Other.SkippedUnchanged;
+			return *this;
+		}
+	};
+
+	enum class ESetStateResult : uint8_t
+	{
+		Entered,
+		//No state is bound to the requested enum.
+		Unassigned,
+		//The new state's OnSetStateConditionCheck returned false.
+		ConditionFailed,
+		//The transition table does not allow entering the new state from the current one.
+		Disallowed,
+		//The request was queued and lost to a higher priority request applied in the same commit.
+		Superseded,
+		//The new state's region is not active, or a cross-region guard of the new state failed.
+		Blocked,
+	};
+
+	//The calls the core makes into a state, for dispatch probes.
+	enum class EStateDispatch : uint8_t
+	{
+		ConditionCheck,
+		Enter,
+		Update,
+		Exit,
+		Detect,
+		Count,
+	};
+
+	//Probes wrap every call the core makes into a state, Probe(Enum, Dispatch, Call) has to return Call().
+	//This one does nothing and is what SetState and Update use when no probe is passed, so it costs nothing.
+	struct FNullDispatchProbe
+	{
+		template <typename EnumType, typename CallType>
+		decltype(auto) operator()(const EnumType, const EStateDispatch, CallType&& Call)
+		{
+			return Call();
+		}
+	};
+
+	//Bindings, regions, guards and the transition table of a machine. It holds no state pointers and does not change once the machine
+	//is set up, so machines set up the same way can all point at one of these, see TStateMachineCore::SetDefinition.
+	template <typename EnumType, int NumStates, int MaxRegions = 8>
+	struct TStateMachineDefinition
+	{
+		using FTransitionTable = TTransitionTable<EnumType, NumStates>;
+
+		struct FRegionLayout
+		{
+			uint64_t StateMask = 0;
+			//First state bound to the region, the one it starts in.
+			EnumType Initial = EnumType();
+			EnumType ParentState = EnumType();
+			bool HasParent = false;
+		};
+
+		FTransitionTable Table;
+		FRegionLayout Regions[MaxRegions];
+		EnumType PriorityOrder[NumStates] = {};
+		uint8_t RegionOf[NumStates] = {};
+		uint64_t RequiredGuards[NumStates] = {};
+		uint64_t BlockedGuards[NumStates] = {};
+		uint64_t AssignedMask = 0;
+		uint64_t GuardedMask = 0;
+		int NumBound = 0;
+		int NumRegions = 1;
+
+		//Adds an orthogonal region that runs next to region 0. It starts in its first bound state when region 0 gets its first state.
+		//Returns the region index, or -1 if there is no room left.
+		int AddRegion()
+		{
+			if (NumRegions >= MaxRegions) return -1;
+			return NumRegions++;
+		}
+
+		//Adds a sub-state region of ParentState. It starts in its first bound state whenever ParentState is entered and exits with it.
+		//ParentState has to be bound already. Returns the region index, or -1.
+		int AddRegion(const EnumType ParentState)
+		{
+			if ((AssignedMask & StateBit(ParentState)) == 0) return -1;
+
+			const int Index = AddRegion();
+			if (Index < 0) return -1;
+
+			Regions[Index].ParentState = ParentState;
+			Regions[Index].HasParent = true;
+			return Index;
+		}
+
+		//Binds an enum to a region. Binding order is priority order for detection. Returns false if the enum is already bound or the
+		//region does not exist. The first state bound to a region is the one it starts in.
+		bool BindState(const EnumType Enum, const int Region = 0)
+		{
+			if ((AssignedMask & StateBit(Enum)) != 0 || Region < 0 || Region >= NumRegions) return false;
+
+			RegionOf[static_cast<uint8_t>(Enum)] = static_cast<uint8_t>(Region);
+			PriorityOrder[NumBound++] = Enum;
+			AssignedMask |= StateBit(Enum);
+
+			if (Regions[Region].StateMask == 0) Regions[Region].Initial = Enum;
+			Regions[Region].StateMask |= StateBit(Enum);
+			return true;
+		}
+
+		//Cross-region guards. Enum can only be entered while every state in RequiredMask is active in another region, and none of
+		//the states in BlockedMask are.
+		void SetGuards(const EnumType Enum, const uint64_t RequiredMask, const uint64_t BlockedMask)
+		{
+			const uint8_t Index = static_cast<uint8_t>(Enum);
+			RequiredGuards[Index] = RequiredMask;
+			BlockedGuards[Index] = BlockedMask;
+
+			if ((RequiredMask | BlockedMask) != 0) GuardedMask |= StateBit(Enum);
+			else GuardedMask &= ~StateBit(Enum);
+		}
+
+		//Compares what the machine does with the definition, for sharing one between machines. Entries past NumBound and NumRegions
+		//are never read, so they are not compared.
+		bool operator==(const TStateMachineDefinition& Other) const
+		{
+			if (NumBound != Other.NumBound || NumRegions != Other.NumRegions || AssignedMask != Other.AssignedMask
+				|| GuardedMask != Other.GuardedMask || !(Table == Other.Table))
+			{
+				return false;
+			}
+			for (int Index = 0; Index < NumBound; ++Index)
+			{
+				if (PriorityOrder[Index] != Other.PriorityOrder[Index]) return false;
+			}
+			for (int Index = 0; Index < NumStates; ++Index)
+			{
+				if (RegionOf[Index] != Other.RegionOf[Index] || RequiredGuards[Index] != Other.RequiredGuards[Index]
+					|| BlockedGuards[Index] != Other.BlockedGuards[Index])
+				{
+					return false;
+				}
+			}
+			for (int Index = 0; Index < NumRegions; ++Index)
+			{
+				const FRegionLayout& Region = Regions[Index];
+				const FRegionLayout& OtherRegion = Other.Regions[Index];
+				if (Region.StateMask != OtherRegion.StateMask || Region.Initial != OtherRegion.Initial
+					|| Region.ParentState != OtherRegion.ParentState || Region.HasParent != OtherRegion.HasParent)
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+	};
+
+	template <typename EnumType, typename StateType, int NumStates, int MaxRegions = 8>
+	class TStateMachineCore
+	{
+	public:
+		using FDefinition = TStateMachineDefinition<EnumType, NumStates, MaxRegions>;
+		using FTransitionTable = typename FDefinition::FTransitionTable;
+
+		static constexpr int MaxNumRegions = MaxRegions;
+
+		//Used by SaveCurrentStates for regions without a current state.
+		static constexpr uint8_t NoState = 0xFF;
+
+		//Drops the definition, every binding and the current states.
+		void Reset()
+		{
+			*this = TStateMachineCore();
+		}
+
+		//Points the machine at what it is made of. Definition is only read, never copied, so it has to outlive the machine and can be
+		//shared with other machines. Drops every binding and current state, bind the state objects again afterwards.
+		void SetDefinition(const FDefinition& InDefinition)
+		{
+			Reset();
+			Definition = &InDefinition;
+		}
+
+		const FDefinition& GetDefinition() const { return *Definition; }
+
+		//Gives the state object for an enum bound in the definition. Returns false if the definition does not bind the enum.
+		bool BindState(const EnumType Enum, StateType* State)
+		{
+			if (State == nullptr || (Definition->AssignedMask & StateBit(Enum)) == 0) return false;
+
+			Lookup[static_cast<uint8_t>(Enum)] = State;
+			AssignedMask |= StateBit(Enum);
+			return true;
+		}
+
+		//Drops the current state of every region without calling OnExitState, keeping the definition and the bindings.
+		//For pooled owners that are reused as if freshly spawned.
+		void ClearCurrentStates()
+		{
+			for (int Region = 0; Region < Definition->NumRegions; ++Region)
+			{
+				Regions[Region] = FRegion();
+			}
+			ActiveMask = 0;
+			Stats = FDetectionStats();
+		}
+
+		//Writes the current state of every region into States, MaxNumRegions entries with NoState where a region has none, and
+		//returns the mask of regions whose update runs. That is all RestoreCurrentStates needs to put the machine back.
+		uint32_t SaveCurrentStates(uint8_t* States) const
+		{
+			static_assert(MaxRegions <= 32, "The run update mask has one bit per region.");
+
+			uint32_t RunUpdateMask = 0;
+			for (int Region = 0; Region < MaxRegions; ++Region)
+			{
+				const FRegion& RegionData = Regions[Region];
+				States[Region] = Region < Definition->NumRegions && RegionData.Current != nullptr ? static_cast<uint8_t>(RegionData.CurrentEnum) : NoState;
+				if (RegionData.RunUpdate) RunUpdateMask |= 1u << Region;
+			}
+			return RunUpdateMask;
+		}
+
+		//Puts back what SaveCurrentStates wrote, without calling OnExitState or OnEnterState.
+		void RestoreCurrentStates(const uint8_t* States, const uint32_t RunUpdateMask)
+		{
+			ActiveMask = 0;
+			for (int Region = 0; Region < Definition->NumRegions; ++Region)
+			{
+				FRegion& RegionData = Regions[Region];
+				const bool HasState = States[Region] != NoState;
+				RegionData.CurrentEnum = HasState ? static_cast<EnumType>(States[Region]) : EnumType();
+				RegionData.Current = HasState ? Lookup[States[Region]] : nullptr;
+				RegionData.RunUpdate = RegionData.Current != nullptr && (RunUpdateMask & (1u << Region)) != 0;
+				if (RegionData.Current != nullptr) ActiveMask |= StateBit(RegionData.CurrentEnum);
+			}
+		}
+
+		const FTransitionTable& GetTransitionTable() const { return Definition->Table; }
+
+		StateType* Translate(const EnumType Enum) const { return Lookup[static_cast<uint8_t>(Enum)]; }
+
+		//Current state of region 0.
+		StateType* GetCurrentState() const { return Regions[0].Current; }
+		EnumType GetCurrentEnumState() const { return Regions[0].CurrentEnum; }
+
+		StateType* GetCurrentState(const int Region) const { return Regions[Region].Current; }
+		EnumType GetCurrentEnumState(const int Region) const { return Regions[Region].CurrentEnum; }
+
+		int GetNumRegions() const { return Definition->NumRegions; }
+		int GetRegionOf(const EnumType Enum) const { return Definition->RegionOf[static_cast<uint8_t>(Enum)]; }
+
+		//Mask of the current state of every region.
+		uint64_t GetActiveMask() const { return ActiveMask; }
+		bool IsActive(const EnumType Enum) const { return (ActiveMask & StateBit(Enum)) != 0; }
+
+		//True if any region has a state that should be updated.
+		bool ShouldRunUpdate() const
+		{
+			for (int Region = 0; Region < Definition->NumRegions; ++Region)
+			{
+				if (Regions[Region].Current != nullptr && Regions[Region].RunUpdate) return true;
+			}
+			return false;
+		}
+
+		//Mask of every state with a state object bound to it.
+		uint64_t GetAssignedMask() const { return AssignedMask; }
+
+		//Mask of bound states that could be entered from the current state of their region, excluding the current states themselves
+		//and states whose guards fail.
+		uint64_t GetDetectableMask() const
+		{
+			uint64_t Mask = 0;
+			for (int Region = 0; Region < Definition->NumRegions; ++Region)
+			{
+				const FRegion& RegionData = Regions[Region];
+				if (RegionData.Current == nullptr) continue;
+				Mask |= Definition->Table.GetEnterableMask(RegionData.CurrentEnum) & Definition->Regions[Region].StateMask & ~StateBit(RegionData.CurrentEnum);
+			}
+			Mask &= AssignedMask;
+
+			if ((Mask & Definition->GuardedMask) != 0)
+			{
+				for (int Index = 0; Index < NumStates; ++Index)
+				{
+					const EnumType Enum = static_cast<EnumType>(Index);
+					if ((Mask & Definition->GuardedMask & StateBit(Enum)) != 0 && !PassesGuards(Enum)) Mask &= ~StateBit(Enum);
+				}
+			}
+			return Mask;
+		}
+
+		int GetNumBound() const { return Definition->NumBound; }
+		EnumType GetBoundEnum(const int PriorityIndex) const { return Definition->PriorityOrder[PriorityIndex]; }
+
+		const FDetectionStats& GetDetectionStats() const { return Stats; }
+
+		//The checks of SetState that only depend on what is bound and the transition table, for requests applied later. Entered
+		//means the request can still succeed, guards and conditions are left to the commit.
+		ESetStateResult CheckRequest(const EnumType NewState) const
+		{
+			if (Translate(NewState) == nullptr) return ESetStateResult::Unassigned;
+
+			const FRegion& Region = Regions[GetRegionOf(NewState)];
+			if (Region.Current != nullptr && !Definition->Table.CanTransition(Region.CurrentEnum, NewState)) return ESetStateResult::Disallowed;
+			return ESetStateResult::Entered;
+		}
+
+		//Switches the region of NewState to it. Leaving a state exits its sub-state regions first, entering one starts them.
+		template <typename ContextType, typename ProbeType = FNullDispatchProbe>
+		ESetStateResult SetState(const EnumType NewState, ContextType& Context, ProbeType&& Probe = ProbeType())
+		{
+			StateType* NewStatePtr = Translate(NewState);
+
+			//If OnSetStateCondition returns false, it means the conditions are not meant for the new state, thus aborting switching state.
+			if (NewStatePtr == nullptr) return ESetStateResult::Unassigned;
+
+			const int RegionIndex = GetRegionOf(NewState);
+			if (!IsRegionActive(RegionIndex) || !PassesGuards(NewState)) return ESetStateResult::Blocked;
+
+			if (!Probe(NewState, EStateDispatch::ConditionCheck, [&]() { return NewStatePtr->OnSetStateConditionCheck(Context); }))
+			{
+				return ESetStateResult::ConditionFailed;
+			}
+
+			FRegion& Region = Regions[RegionIndex];
+			const bool StartsMachine = RegionIndex == 0 && Region.Current == nullptr;
+			if (Region.Current != nullptr)
+			{
+				//If the new state does not allow the change from the current state, return.
+				if (!Definition->Table.CanTransition(Region.CurrentEnum, NewState)) return ESetStateResult::Disallowed;
+
+				ExitRegion(RegionIndex, Context, Probe);
+			}
+
+			Region.Current = NewStatePtr;
+			Region.CurrentEnum = NewState;
+			ActiveMask |= StateBit(NewState);
+			Probe(NewState, EStateDispatch::Enter, [&]() { NewStatePtr->OnEnterState(Context); });
+			Region.RunUpdate = true;
+
+			for (int Other = RegionIndex + 1; Other < Definition->NumRegions; ++Other)
+			{
+				const typename FDefinition::FRegionLayout& OtherLayout = Definition->Regions[Other];
+				const bool Starts = OtherLayout.HasParent ? OtherLayout.ParentState == NewState : StartsMachine;
+				if (Starts && Regions[Other].Current == nullptr && OtherLayout.StateMask != 0) SetState(OtherLayout.Initial, Context, Probe);
+			}
+			return ESetStateResult::Entered;
+		}
+
+		//Updates the current state of every region, parents before their sub-states.
+		template <typename ContextType, typename ProbeType = FNullDispatchProbe>
+		void Update(ContextType& Context, ProbeType&& Probe = ProbeType())
+		{
+			ForEachUpdatingState(Probe, [&Context](StateType& State) { State.OnUpdateState(Context); });
+		}
+
+		//Same as Update, with the time step handed to the states instead of them reading the frame's delta.
+		template <typename ContextType, typename ProbeType = FNullDispatchProbe>
+		void Step(ContextType& Context, const float DeltaTime, ProbeType&& Probe = ProbeType())
+		{
+			ForEachUpdatingState(Probe, [&Context, DeltaTime](StateType& State) { State.OnUpdateState(Context, DeltaTime); });
+		}
+
+		//Walks the bound states in priority order and calls RunDetector(Enum, State) on each one that is enterable from the current
+		//state of its region and set in DirtyMask. Once a detector switched its region's state, the rest of that region is skipped,
+		//they would be detecting from a state that is no longer current. Other regions keep detecting. RunDetector can also return
+		//true to settle its region, for example after queueing a transition.
+		template <typename DetectorFunc>
+		void Detect(const uint64_t DirtyMask, DetectorFunc&& RunDetector)
+		{
+			Stats = FDetectionStats();
+
+			const int NumBound = Definition->NumBound;
+			uint64_t DetectableMask = GetDetectableMask();
+			uint64_t SettledMask = 0;
+			for (int Index = 0; Index < NumBound; ++Index)
+			{
+				const EnumType Enum = Definition->PriorityOrder[Index];
+				const uint64_t Bit = StateBit(Enum);
+				if ((SettledMask & Bit) != 0)
+				{
+					Stats.SkippedAfterTransition++;
+					continue;
+				}
+				if ((DetectableMask & Bit) == 0)
+				{
+					Stats.SkippedDisallowed++;
+					continue;
+				}
+				if ((DirtyMask & Bit) == 0)
+				{
+					Stats.SkippedUnchanged++;
+					continue;
+				}
+
+				Stats.Evaluated++;
+				const int RegionIndex = GetRegionOf(Enum);
+				const StateType* StateBefore = Regions[RegionIndex].Current;
+				const uint64_t ActiveBefore = ActiveMask;
+				const bool Stop = RunDetector(Enum, *Lookup[static_cast<uint8_t>(Enum)]);
+
+				if (Stop || Regions[RegionIndex].Current != StateBefore)
+				{
+					SettledMask |= Definition->Regions[RegionIndex].StateMask;
+					if ((AssignedMask & ~SettledMask) == 0)
+					{
+						Stats.SkippedAfterTransition += NumBound - Index - 1;
+						break;
+					}
+				}
+
+				//Guards and sub-state regions follow the new set of active states.
+				if (ActiveMask != ActiveBefore) DetectableMask = GetDetectableMask();
+			}
+		}
+
+	private:
+		//What changes at runtime in a region. The rest of it is in the definition.
+		struct FRegion
+		{
+			StateType* Current = nullptr;
+			EnumType CurrentEnum = EnumType();
+			bool RunUpdate = false;
+		};
+
+		//Region 0 is always active. Sub-state regions are active while their parent is, other regions once region 0 has a state.
+		bool IsRegionActive(const int RegionIndex) const
+		{
+			if (RegionIndex == 0) return true;
+			const typename FDefinition::FRegionLayout& Layout = Definition->Regions[RegionIndex];
+			return Layout.HasParent ? IsActive(Layout.ParentState) : Regions[0].Current != nullptr;
+		}
+
+		bool PassesGuards(const EnumType Enum) const
+		{
+			const uint8_t Index = static_cast<uint8_t>(Enum);
+			const uint64_t OtherRegionsActive = ActiveMask & ~Definition->Regions[Definition->RegionOf[Index]].StateMask;
+			const uint64_t Required = Definition->RequiredGuards[Index];
+			return (OtherRegionsActive & Required) == Required && (OtherRegionsActive & Definition->BlockedGuards[Index]) == 0;
+		}
+
+		template <typename ProbeType, typename OpType>
+		void ForEachUpdatingState(ProbeType& Probe, OpType&& Op)
+		{
+			for (int RegionIndex = 0; RegionIndex < Definition->NumRegions; ++RegionIndex)
+			{
+				FRegion& Region = Regions[RegionIndex];
+				if (Region.Current == nullptr || !Region.RunUpdate) continue;
+
+				StateType* State = Region.Current;
+				Probe(Region.CurrentEnum, EStateDispatch::Update, [&]() { Op(*State); });
+			}
+		}
+
+		//Exits the current state of a region, after the sub-state regions nested under it.
+		template <typename ContextType, typename ProbeType>
+		void ExitRegion(const int RegionIndex, ContextType& Context, ProbeType& Probe)
+		{
+			//Never taken, NumRegions is at most MaxRegions. Spelled out so the recursion is visibly bounded, GCC warns about the
+			//region arrays without it once it inlines a few levels.
+			if (RegionIndex >= MaxRegions) return;
+
+			FRegion& Region = Regions[RegionIndex];
+			for (int Other = RegionIndex + 1; Other < Definition->NumRegions; ++Other)
+			{
+				const typename FDefinition::FRegionLayout& OtherLayout = Definition->Regions[Other];
+				if (OtherLayout.HasParent && OtherLayout.ParentState == Region.CurrentEnum && Regions[Other].Current != nullptr)
+				{
+					ExitRegion(Other, Context, Probe);
+				}
+			}
+
+			StateType* State = Region.Current;
+			Region.RunUpdate = false;
+			Probe(Region.CurrentEnum, EStateDispatch::Exit, [&]() { State->OnExitState(Context); });
+			ActiveMask &= ~StateBit(Region.CurrentEnum);
+			Region.Current = nullptr;
+		}
+
+		//What a machine without a definition points at, a single empty region.
+		static inline const FDefinition EmptyDefinition = FDefinition();
+
+		const FDefinition* Definition = &EmptyDefinition;
+		StateType* Lookup[NumStates] = {};
+		FRegion Regions[MaxRegions];
+		FDetectionStats Stats;
+		uint64_t AssignedMask = 0;
+		uint64_t ActiveMask = 0;
+	};
+}
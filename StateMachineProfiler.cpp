@@ -0,0 +1,36 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "StateMachineProfiler.h"
+#include "CharacterStateMachine.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "UObject/UObjectIterator.h"
+
+#if WITH_STATE_MACHINE_PROFILING
+
+static FAutoConsoleCommandWithWorld ExportStateMachineProfileCommand(
+	TEXT("StateMachine.ExportProfile"),
+	TEXT("Writes the summed dispatch timings, time-in-state and transition counts of every state machine in the world to Saved/Profiling as CSV."),
+	FConsoleCommandWithWorldDelegate::CreateLambda([](UWorld* World)
+	{
+		FCharacterStateMachineProfiler Total;
+		int32 NumMachines = 0;
+		for (TObjectIterator<UCharacterStateMachine> It; It; ++It)
+		{
+			if (It->GetWorld() != World) continue;
+			Total += It->GetProfiler();
+			NumMachines++;
+		}
+
+		FString CSV;
+		Total.WriteCSV(CSV);
+		CSV += FString::Printf(TEXT("Summary,,Machines,%d\n"), NumMachines);
+
+		const FString FilePath = FPaths::ProfilingDir() / FString::Printf(TEXT("StateMachineProfile_%s.csv"), *FDateTime::Now().ToString());
+		if (FFileHelper::SaveStringToFile(CSV, *FilePath))
+		{
+			UE_LOG(LogTemp, Log, TEXT("State machine profile written to %s"), *FilePath);
+		}
+	}));
+
+#endif
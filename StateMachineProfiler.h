@@ -0,0 +1,221 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+#include "StateMachineCore.h"
+
+//Per-state dispatch timing for the state machine. Off in shipping builds by default, define it in the module's Build.cs to override.
+//When off, TStateMachineProfiler is an empty FNullDispatchProbe and every probe call inlines away.
+#ifndef WITH_STATE_MACHINE_PROFILING
+#define WITH_STATE_MACHINE_PROFILING !UE_BUILD_SHIPPING
+#endif
+
+DECLARE_STATS_GROUP(TEXT("Character State Machine"), STATGROUP_CharacterStateMachine, STATCAT_Advanced);
+
+#if WITH_STATE_MACHINE_PROFILING
+
+//Dispatch probe that times and counts every call a machine makes into its states, and keeps histograms of how long states
+//last and which transitions happen. Shows up under "stat CharacterStateMachine" as one timer per state and dispatch, and
+//StateMachine.ExportProfile writes the totals of every machine to CSV.
+//Game thread only, the parallel QueryDetectState phase is not probed.
+template <typename EnumType, int32 NumStates>
+class TStateMachineProfiler
+{
+public:
+	static constexpr int32 NumDispatches = static_cast<int32>(StateMachineCore::EStateDispatch::Count);
+
+	//Time-in-state buckets are powers of two in milliseconds, the first one is everything under 1ms and the last everything above.
+	static constexpr int32 NumTimeInStateBuckets = 16;
+
+	//Cycles are exclusive. A Detect that enters a state leaves the Exit and Enter it caused to their own counters, so the totals
+	//of all dispatches add up to the time spent in them.
+	struct FDispatchCounter
+	{
+		uint64 Calls = 0;
+		uint64 Cycles = 0;
+		uint64 MaxCycles = 0;
+	};
+
+	template <typename CallType>
+	FORCEINLINE decltype(auto) operator()(const EnumType State, const StateMachineCore::EStateDispatch Dispatch, CallType&& Call)
+	{
+		if (Dispatch == StateMachineCore::EStateDispatch::Enter) RecordEnter(State);
+		else if (Dispatch == StateMachineCore::EStateDispatch::Exit) RecordExit(State);
+
+#if STATS
+		FScopeCycleCounter StatScope(GetStatId(State, Dispatch));
+#endif
+		FScopedDispatchTimer Timer(Counters[static_cast<uint8>(State)][static_cast<uint8>(Dispatch)], NestedCycles);
+		return Call();
+	}
+
+	void Reset()
+	{
+		*this = TStateMachineProfiler();
+	}
+
+	TStateMachineProfiler& operator+=(const TStateMachineProfiler& Other)
+	{
+		for (int32 State = 0; State < NumStates; ++State)
+		{
+			for (int32 Dispatch = 0; Dispatch < NumDispatches; ++Dispatch)
+			{
+				FDispatchCounter& Counter = Counters[State][Dispatch];
+				const FDispatchCounter& OtherCounter = Other.Counters[State][Dispatch];
+				Counter.Calls += OtherCounter.Calls;
+				Counter.Cycles += OtherCounter.Cycles;
+				Counter.MaxCycles = FMath::Max(Counter.MaxCycles, OtherCounter.MaxCycles);
+			}
+			for (int32 Bucket = 0; Bucket < NumTimeInStateBuckets; ++Bucket)
+			{
+				TimeInState[State][Bucket] += Other.TimeInState[State][Bucket];
+			}
+			for (int32 To = 0; To < NumStates; ++To)
+			{
+				Transitions[State][To] += Other.Transitions[State][To];
+			}
+		}
+		return *this;
+	}
+
+	//Appends the counters as long-format CSV rows, Section,State,Name,Value, so runs can be diffed and graphed row by row.
+	void WriteCSV(FString& Out, const bool WriteHeader = true) const
+	{
+		static const TCHAR* DispatchNames[] = { TEXT("ConditionCheck"), TEXT("Enter"), TEXT("Update"), TEXT("Exit"), TEXT("Detect") };
+		static_assert(UE_ARRAY_COUNT(DispatchNames) == NumDispatches, "Name every StateMachineCore::EStateDispatch.");
+
+		if (WriteHeader) Out += TEXT("Section,State,Name,Value\n");
+
+		const double MsPerCycle = FPlatformTime::GetSecondsPerCycle64() * 1000.0;
+		for (int32 State = 0; State < NumStates; ++State)
+		{
+			const FString StateName = GetStateName(State);
+			for (int32 Dispatch = 0; Dispatch < NumDispatches; ++Dispatch)
+			{
+				const FDispatchCounter& Counter = Counters[State][Dispatch];
+				if (Counter.Calls == 0) continue;
+
+				Out += FString::Printf(TEXT("Dispatch,%s,%s.Calls,%llu\n"), *StateName, DispatchNames[Dispatch], Counter.Calls);
+				Out += FString::Printf(TEXT("Dispatch,%s,%s.TotalMs,%.4f\n"), *StateName, DispatchNames[Dispatch], Counter.Cycles * MsPerCycle);
+				Out += FString::Printf(TEXT("Dispatch,%s,%s.MaxMs,%.4f\n"), *StateName, DispatchNames[Dispatch], Counter.MaxCycles * MsPerCycle);
+			}
+			for (int32 Bucket = 0; Bucket < NumTimeInStateBuckets; ++Bucket)
+			{
+				if (TimeInState[State][Bucket] == 0) continue;
+				Out += FString::Printf(TEXT("TimeInState,%s,<%dms,%u\n"), *StateName, 1 << Bucket, TimeInState[State][Bucket]);
+			}
+			for (int32 To = 0; To < NumStates; ++To)
+			{
+				if (Transitions[State][To] == 0) continue;
+				Out += FString::Printf(TEXT("Transition,%s,%s,%u\n"), *StateName, *GetStateName(To), Transitions[State][To]);
+			}
+		}
+	}
+
+private:
+	//Collects the time of the dispatches nested in this one in InNestedCycles and takes it off its own, then hands its whole
+	//time to the dispatch around it.
+	struct FScopedDispatchTimer
+	{
+		FScopedDispatchTimer(FDispatchCounter& InCounter, uint64& InNestedCycles)
+			: Counter(InCounter), NestedCycles(InNestedCycles), OuterNestedCycles(InNestedCycles), StartCycles(FPlatformTime::Cycles64())
+		{
+			NestedCycles = 0;
+		}
+
+		~FScopedDispatchTimer()
+		{
+			const uint64 Elapsed = FPlatformTime::Cycles64() - StartCycles;
+			const uint64 Exclusive = Elapsed - FMath::Min(NestedCycles, Elapsed);
+			Counter.Calls++;
+			Counter.Cycles += Exclusive;
+			Counter.MaxCycles = FMath::Max(Counter.MaxCycles, Exclusive);
+			NestedCycles = OuterNestedCycles + Elapsed;
+		}
+
+		FDispatchCounter& Counter;
+		uint64& NestedCycles;
+		uint64 OuterNestedCycles;
+		uint64 StartCycles;
+	};
+
+	static FString GetStateName(const int32 State)
+	{
+		return UEnum::GetDisplayValueAsText(static_cast<EnumType>(State)).ToString();
+	}
+
+	//The core exits the old state (after its sub-states) right before entering the new one, so the last exit is where an enter
+	//came from. Enters without an exit before them, like sub-states starting with their parent, count as entered from themselves.
+	void RecordEnter(const EnumType State)
+	{
+		const uint8 Index = static_cast<uint8>(State);
+		Transitions[HasExited ? LastExited : Index][Index]++;
+		HasExited = false;
+		EnterCycles[Index] = FPlatformTime::Cycles64();
+	}
+
+	void RecordExit(const EnumType State)
+	{
+		const uint8 Index = static_cast<uint8>(State);
+		const double Ms = FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - EnterCycles[Index]);
+		const int32 Bucket = Ms < 1.0 ? 0 : FMath::Min<int32>(FMath::FloorLog2(static_cast<uint32>(Ms)) + 1, NumTimeInStateBuckets - 1);
+		TimeInState[Index][Bucket]++;
+		LastExited = Index;
+		HasExited = true;
+	}
+
+#if STATS
+	//One dynamic stat per state and dispatch, shared by every machine and created the first time one asks for them.
+	static TStatId GetStatId(const EnumType State, const StateMachineCore::EStateDispatch Dispatch)
+	{
+		struct FStatTable
+		{
+			TStatId Ids[NumStates][NumDispatches];
+
+			FStatTable()
+			{
+				static const TCHAR* DispatchNames[] = { TEXT("OnSetStateConditionCheck"), TEXT("OnEnterState"), TEXT("OnUpdateState"),
+					TEXT("OnExitState"), TEXT("Detect") };
+
+				for (int32 StateIndex = 0; StateIndex < NumStates; ++StateIndex)
+				{
+					for (int32 DispatchIndex = 0; DispatchIndex < NumDispatches; ++DispatchIndex)
+					{
+						const FString StatName = FString::Printf(TEXT("%s %s"), *GetStateName(StateIndex), DispatchNames[DispatchIndex]);
+						Ids[StateIndex][DispatchIndex] = FDynamicStats::CreateStatId<FStatGroup_STATGROUP_CharacterStateMachine>(StatName);
+					}
+				}
+			}
+		};
+
+		static const FStatTable Table;
+		return Table.Ids[static_cast<uint8>(State)][static_cast<uint8>(Dispatch)];
+	}
+#endif
+
+	FDispatchCounter Counters[NumStates][NumDispatches];
+	uint32 TimeInState[NumStates][NumTimeInStateBuckets] = {};
+	//Transitions[From][To].
+	uint32 Transitions[NumStates][NumStates] = {};
+
+	uint64 EnterCycles[NumStates] = {};
+	//Time of the finished dispatches nested in the one running, see FScopedDispatchTimer.
+	uint64 NestedCycles = 0;
+	uint8 LastExited = 0;
+	bool HasExited = false;
+};
+
+#else
+
+template <typename EnumType, int32 NumStates>
+class TStateMachineProfiler : public StateMachineCore::FNullDispatchProbe
+{
+public:
+	void Reset() {}
+	TStateMachineProfiler& operator+=(const TStateMachineProfiler&) { return *this; }
+	void WriteCSV(FString&, const bool = true) const {}
+};
+
+#endif
@@ -0,0 +1,63 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+//Pool of immutable blocks shared by everything that holds an equal one, like machine definitions and mechanic settings.
+//Acquire hands out the pooled copy of a value, adding it if there is none yet, and Release gives it back. A block is freed with its
+//last reference, so nothing piles up across PIE sessions or respawns. Blocks are found through their hash, Hash(Value), so
+//acquiring costs the same with one distinct block or thousands.
+//Blocks never move, the references Acquire returns stay valid until they are released. Game thread only.
+
+#include "CoreMinimal.h"
+#include "Templates/UniquePtr.h"
+
+template <typename ValueType, uint32 (*Hash)(const ValueType&)>
+class TStateMachineSharedPool
+{
+public:
+	const ValueType& Acquire(const ValueType& Value)
+	{
+		const uint32 ValueHash = Hash(Value);
+		for (typename FEntryMap::TKeyIterator It = Entries.CreateKeyIterator(ValueHash); It; ++It)
+		{
+			if (It.Value()->Value == Value)
+			{
+				It.Value()->NumReferences++;
+				return It.Value()->Value;
+			}
+		}
+		return Entries.Add(ValueHash, MakeUnique<FEntry>(Value))->Value;
+	}
+
+	//Drops a reference Acquire handed out. Null is ignored, so holders can release whatever they have without checking first.
+	void Release(const ValueType* Value)
+	{
+		if (Value == nullptr) return;
+
+		for (typename FEntryMap::TKeyIterator It = Entries.CreateKeyIterator(Hash(*Value)); It; ++It)
+		{
+			if (&It.Value()->Value != Value) continue;
+
+			if (--It.Value()->NumReferences == 0) It.RemoveCurrent();
+			return;
+		}
+		checkf(false, TEXT("Released a block that is not in the pool."));
+	}
+
+	int32 Num() const { return Entries.Num(); }
+
+	//The blocks and the map holding them.
+	SIZE_T GetAllocatedSize() const { return Entries.GetAllocatedSize() + Entries.Num() * sizeof(FEntry); }
+
+private:
+	struct FEntry
+	{
+		explicit FEntry(const ValueType& InValue) : Value(InValue) {}
+
+		ValueType Value;
+		int32 NumReferences = 1;
+	};
+
+	using FEntryMap = TMultiMap<uint32, TUniquePtr<FEntry>>;
+	FEntryMap Entries;
+};
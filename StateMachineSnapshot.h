@@ -0,0 +1,75 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+//Delta encoding for state machine snapshots, plain C++ like StateMachineCore.h.
+//A delta is a list of runs, each a uint16 count of bytes to keep from the previous snapshot, a uint16 count of bytes to copy and
+//the bytes themselves. Unchanged bytes at the end are not written, so two identical snapshots encode to an empty delta.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace StateMachineCore
+{
+	constexpr std::size_t DeltaRunHeaderSize = 2 * sizeof(uint16_t);
+	constexpr std::size_t MaxDeltaRunLength = 0xFFFF;
+
+	//Upper bound of EncodeDelta's output for snapshots of Size bytes.
+	constexpr std::size_t GetMaxDeltaSize(const std::size_t Size)
+	{
+		return Size + 2 * DeltaRunHeaderSize + DeltaRunHeaderSize * (Size / MaxDeltaRunLength);
+	}
+
+	//Writes the delta from Previous to Current into Out, which needs room for GetMaxDeltaSize(Size). Returns the bytes written.
+	inline std::size_t EncodeDelta(const uint8_t* Previous, const uint8_t* Current, const std::size_t Size, uint8_t* Out)
+	{
+		std::size_t Written = 0;
+		std::size_t Position = 0;
+		while (Position < Size)
+		{
+			std::size_t Skip = 0;
+			while (Position + Skip < Size && Skip < MaxDeltaRunLength && Previous[Position + Skip] == Current[Position + Skip]) ++Skip;
+			Position += Skip;
+			if (Position == Size) break;
+
+			//A run ends after DeltaRunHeaderSize unchanged bytes in a row. Shorter gaps are cheaper to copy than to start a new run for.
+			std::size_t End = Position;
+			for (std::size_t Scan = Position; Scan < Size && Scan - Position < MaxDeltaRunLength; ++Scan)
+			{
+				if (Previous[Scan] != Current[Scan]) End = Scan + 1;
+				else if (Scan + 1 - End >= DeltaRunHeaderSize) break;
+			}
+
+			const uint16_t Header[2] = { static_cast<uint16_t>(Skip), static_cast<uint16_t>(End - Position) };
+			std::memcpy(Out + Written, Header, DeltaRunHeaderSize);
+			std::memcpy(Out + Written + DeltaRunHeaderSize, Current + Position, End - Position);
+			Written += DeltaRunHeaderSize + End - Position;
+			Position = End;
+		}
+		return Written;
+	}
+
+	//Rebuilds a snapshot from Previous and a delta made by EncodeDelta. Out can be Previous itself to patch it in place.
+	//Returns false if the delta does not fit a snapshot of Size bytes.
+	inline bool DecodeDelta(const uint8_t* Previous, const uint8_t* Delta, const std::size_t DeltaSize, const std::size_t Size, uint8_t* Out)
+	{
+		if (Out != Previous) std::memcpy(Out, Previous, Size);
+
+		std::size_t Position = 0;
+		std::size_t Read = 0;
+		while (Read + DeltaRunHeaderSize <= DeltaSize)
+		{
+			uint16_t Header[2];
+			std::memcpy(Header, Delta + Read, DeltaRunHeaderSize);
+			Read += DeltaRunHeaderSize;
+			Position += Header[0];
+
+			if (Position + Header[1] > Size || Read + Header[1] > DeltaSize) return false;
+			std::memcpy(Out + Position, Delta + Read, Header[1]);
+			Position += Header[1];
+			Read += Header[1];
+		}
+		return Read == DeltaSize;
+	}
+}
@@ -0,0 +1,100 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "StateMachineTraceRecorder.h"
+#include "CharacterStateMachine.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "UObject/UObjectIterator.h"
+
+namespace
+{
+	//Bump the version whenever the layout below or FStateTraceRecord changes, the timeline tool checks it.
+	constexpr uint32 TraceFileMagic = 0x52544D53; // "SMTR"
+	constexpr uint32 TraceFileVersion = 1;
+
+	struct FTraceFileHeader
+	{
+		uint32 Magic;
+		uint32 Version;
+		uint32 RecordSize;
+		uint32 NumRecords;
+		double SecondsPerCycle;
+		uint32 NumStates;
+		uint32 OwnerNameLength;
+	};
+}
+
+void FStateMachineTraceRecorder::Initialize(const int32 Capacity)
+{
+	Records.Empty();
+	Mask = 0;
+	WriteIndex.store(0, std::memory_order_relaxed);
+
+	if (Capacity <= 0) return;
+
+	const uint32 RoundedCapacity = FMath::RoundUpToPowerOfTwo(static_cast<uint32>(Capacity));
+	Records.SetNumZeroed(RoundedCapacity);
+	Mask = RoundedCapacity - 1;
+}
+
+void FStateMachineTraceRecorder::CopyRecords(TArray<FStateTraceRecord>& OutRecords) const
+{
+	OutRecords.Reset();
+	if (Records.IsEmpty()) return;
+
+	const uint64 End = WriteIndex.load(std::memory_order_acquire);
+	const uint64 Num = FMath::Min<uint64>(End, Records.Num());
+	OutRecords.Reserve(static_cast<int32>(Num));
+	for (uint64 Index = End - Num; Index < End; ++Index)
+	{
+		OutRecords.Add(Records[Index & Mask]);
+	}
+}
+
+bool FStateMachineTraceRecorder::DumpToFile(const FString& FilePath, const FString& OwnerName) const
+{
+	TArray<FStateTraceRecord> Snapshot;
+	CopyRecords(Snapshot);
+
+	const FTCHARToUTF8 OwnerNameUtf8(*OwnerName);
+
+	FTraceFileHeader Header;
+	Header.Magic = TraceFileMagic;
+	Header.Version = TraceFileVersion;
+	Header.RecordSize = sizeof(FStateTraceRecord);
+	Header.NumRecords = Snapshot.Num();
+	Header.SecondsPerCycle = FPlatformTime::GetSecondsPerCycle64();
+	Header.NumStates = NumCharacterStates;
+	Header.OwnerNameLength = OwnerNameUtf8.Length();
+
+	TArray<uint8> Bytes;
+	Bytes.Append(reinterpret_cast<const uint8*>(&Header), sizeof(Header));
+	Bytes.Append(reinterpret_cast<const uint8*>(OwnerNameUtf8.Get()), OwnerNameUtf8.Length());
+
+	//State names, each one a length byte followed by UTF-8, so the tool can label the timeline without knowing the enum.
+	for (int32 StateIndex = 0; StateIndex < NumCharacterStates; ++StateIndex)
+	{
+		const FString Name = UEnum::GetDisplayValueAsText(static_cast<ECharacterState>(StateIndex)).ToString();
+		const FTCHARToUTF8 NameUtf8(*Name);
+		const uint8 Length = static_cast<uint8>(FMath::Min(NameUtf8.Length(), 255));
+		Bytes.Add(Length);
+		Bytes.Append(reinterpret_cast<const uint8*>(NameUtf8.Get()), Length);
+	}
+
+	Bytes.Append(reinterpret_cast<const uint8*>(Snapshot.GetData()), Snapshot.Num() * sizeof(FStateTraceRecord));
+	return FFileHelper::SaveArrayToFile(Bytes, *FilePath);
+}
+
+static FAutoConsoleCommandWithWorld DumpStateMachineTracesCommand(
+	TEXT("StateMachine.DumpTraces"),
+	TEXT("Dumps the transition trace of every state machine in the world to Saved/StateMachineTraces."),
+	FConsoleCommandWithWorldDelegate::CreateLambda([](UWorld* World)
+	{
+		for (TObjectIterator<UCharacterStateMachine> It; It; ++It)
+		{
+			if (It->GetWorld() == World)
+			{
+				It->DumpTransitionTrace(FString());
+			}
+		}
+	}));
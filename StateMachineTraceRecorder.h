@@ -0,0 +1,91 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include <atomic>
+
+enum class EStateTraceEvent : uint8
+{
+	//A transition was attempted. Payload is the cycles spent in it, Result is a StateMachineCore::ESetStateResult.
+	Transition,
+	//A state was entered or exited, From is the state.
+	Enter,
+	Exit,
+	//A transition was queued with RequestState, To is the requested state.
+	Request,
+	//A queued request did not make it, Result is why.
+	RequestRejected,
+	//A detector ran. To is its state, Payload is the cycles it took. Verbose, only recorded by machines with TraceDetectors on.
+	Detector,
+};
+
+//Fixed-size binary record, written as-is into the ring buffer and the dump file.
+struct FStateTraceRecord
+{
+	//FPlatformTime::Cycles64 when the event happened.
+	uint64 Timestamp;
+	uint32 Payload;
+	EStateTraceEvent Type;
+	uint8 From;
+	uint8 To;
+	uint8 Result;
+};
+static_assert(sizeof(FStateTraceRecord) == 16, "FStateTraceRecord is part of the dump file format, keep it at 16 bytes.");
+
+//Per-machine ring buffer of FStateTraceRecord. Writing is a single atomic increment and a 16 byte copy, no locks and no allocation,
+//so it is cheap enough to keep on in shipping builds. Old records are overwritten once the buffer wraps.
+//Dump files are read by Tools/StateMachineTraceToTimeline.py.
+class CHASING_5SD073_API FStateMachineTraceRecorder
+{
+public:
+	//Used in From and To when there is no state, for example the first transition of a machine.
+	static constexpr uint8 NoState = 0xFF;
+
+	//Allocates the buffer, rounded up to a power of two. Zero turns recording off.
+	void Initialize(const int32 Capacity);
+
+	bool IsRecording() const { return !Records.IsEmpty(); }
+
+	SIZE_T GetAllocatedSize() const { return Records.GetAllocatedSize(); }
+
+	FORCEINLINE void Record(const EStateTraceEvent Type, const uint8 From, const uint8 To, const uint8 Result = 0, const uint32 Payload = 0)
+	{
+		if (Records.IsEmpty()) return;
+
+		const uint64 Index = WriteIndex.fetch_add(1, std::memory_order_relaxed);
+		Records[Index & Mask] = { FPlatformTime::Cycles64(), Payload, Type, From, To, Result };
+	}
+
+	//Index the next record is written at. Readers that poll for new records remember it and read up to it with GetRecord.
+	uint64 GetWriteIndex() const { return WriteIndex.load(std::memory_order_acquire); }
+
+	//Index of the oldest record still in the buffer. Readers that fell behind it lost the records in between.
+	uint64 GetOldestIndex() const
+	{
+		const uint64 End = GetWriteIndex();
+		const uint64 Capacity = static_cast<uint64>(Records.Num());
+		return End > Capacity ? End - Capacity : 0;
+	}
+
+	//Returns false if the record at Index was not written yet or was overwritten since.
+	bool GetRecord(const uint64 Index, FStateTraceRecord& OutRecord) const
+	{
+		const uint64 End = GetWriteIndex();
+		if (Index >= End || End - Index > static_cast<uint64>(Records.Num())) return false;
+
+		OutRecord = Records[Index & Mask];
+		return true;
+	}
+
+	//Copies the records still in the buffer out, oldest first.
+	void CopyRecords(TArray<FStateTraceRecord>& OutRecords) const;
+
+	//Writes the buffer to a compact binary file: a header, the ECharacterState names, then the raw records.
+	bool DumpToFile(const FString& FilePath, const FString& OwnerName) const;
+
+private:
+	TArray<FStateTraceRecord> Records;
+	uint64 Mask = 0;
+	std::atomic<uint64> WriteIndex{0};
+};
@@ -0,0 +1,14 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "StateMechanicDefinition.h"
+
+UStateMechanicDefinition::UStateMechanicDefinition()
+{
+	//Every state is listed and allowed by default, like on the component. The list is fixed size in the editor, so every new
+	//asset has to start with it filled in.
+	for (int32 Index = 0; Index < NumCharacterStates; ++Index)
+	{
+		CanTransitionFromStateList.Add(static_cast<ECharacterState>(Index), true);
+	}
+}
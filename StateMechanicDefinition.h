@@ -0,0 +1,60 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/DataAsset.h"
+#include "StateComponentBase.h"
+#include "StateMechanicDefinition.generated.h"
+
+//Settings of a mechanic, shared by every character whose mechanic points at it through UStateComponentBase::Definition.
+//Same settings as the ones on the component, edited once here instead of on every character Blueprint. In game worlds, play in
+//editor included, the components using one drop their own copy of the editable settings, see UStateComponentBase::RefreshSettings.
+UCLASS(BlueprintType)
+class CHASING_5SD073_API UStateMechanicDefinition : public UDataAsset
+{
+	GENERATED_BODY()
+
+public:
+	UStateMechanicDefinition();
+
+	UPROPERTY(EditFixedSize, EditAnywhere, Category = "Settings|General Settings",
+		meta = (ToolTip = "The list describes FROM which states this state can transtion"))
+	TMap<ECharacterState, bool> CanTransitionFromStateList;
+
+	UPROPERTY(EditAnywhere, Category = "Settings|Regions",
+		meta = (ToolTip = "This state can only be entered while all of these are active in other regions of the state machine."))
+	TArray<ECharacterState> RequiredActiveStates;
+
+	UPROPERTY(EditAnywhere, Category = "Settings|Regions",
+		meta = (ToolTip = "This state cannot be entered while any of these is active in another region of the state machine."))
+	TArray<ECharacterState> BlockedByActiveStates;
+
+	UPROPERTY(EditAnywhere, Category = "Settings|General Settings")
+	bool CountTowardsFalling = false;
+
+	UPROPERTY(EditAnywhere, Category = "Settings|General Settings")
+	bool ResetsDash = false;
+
+	UPROPERTY(EditAnywhere, Category = "Settings|General Settings",
+		meta = (ToolTip = "Broadcasts the On Enter, On Update and On Exit Blueprint events. Leave off if nothing in Blueprints listens to them."))
+	bool BroadcastBlueprintEvents = false;
+
+	UPROPERTY(EditAnywhere, Category = "Settings|General Settings",
+		meta = (ToolTip = "When the results of traces queued with QueueLineTrace become readable."))
+	EStateTraceLatency TraceLatency = EStateTraceLatency::SameFrame;
+
+	UPROPERTY(EditAnywhere, Category = "Settings|Detection Settings", meta = (Bitmask, BitmaskEnum = "/Script/Chasing_5SD073.EDetectionDependency",
+		ToolTip = "What detection of this mechanic depends on. Leave empty to detect every frame. A change of the current state always re-runs detection."))
+	int32 DetectionDependencies = 0;
+
+	UPROPERTY(EditAnywhere, Category = "Settings|Detection Settings", meta = (ClampMin = 0))
+	float DetectionVelocityThreshold = 10;
+
+	UPROPERTY(EditAnywhere, Category = "Settings|Detection Settings", meta = (ClampMin = 0))
+	float DetectionPollInterval = 0.25f;
+
+	UPROPERTY(EditAnywhere, Category = "Settings|Detection Settings", meta = (
+		ToolTip = "Enters this mechanic when all of these hold, instead of calling OverrideDetectState. Batched machines test them for all characters at once. At most 4."))
+	TArray<FStatePredicateTerm> DetectionPredicate;
+};
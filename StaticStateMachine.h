@@ -0,0 +1,197 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+//Compile-time specialization of the state machine for fixed mechanic sets, like the shipping character.
+//The state list and the transition table are template parameters, so transition checks are constexpr and every call into a state
+//is a qualified, non-virtual call on its concrete type that the compiler can inline. Dispatch over the bindings folds into a chain
+//of constant compares, which compiles down to a switch.
+//The data-driven TStateMachineCore / UCharacterStateMachine stays the way to prototype.
+//
+//States get the same calls as in StateMachineCore.h, plus OverrideDetectState(ContextType&), with whatever context is passed in.
+//Their detectors have to switch through that context: a mechanic written against UCharacterStateMachine calls SetState on the
+//runtime machine, which this machine never sees, so those do not move over unchanged. Pass a TStaticStateMachineContext, or any
+//context whose SetState forwards here, and write the states against it. Standalone/StateMachineCoreTests.cpp has a compiled example.
+//
+//Usage:
+//	constexpr FStateTransitionTable BuildShippingTransitions() { FStateTransitionTable Table; Table.Allow(...); return Table; }
+//	struct FShippingTransitions { static constexpr FStateTransitionTable Table = BuildShippingTransitions(); };
+//	using FShippingStateMachine = StateMachineCore::TStaticStateMachine<FShippingTransitions,
+//		StateMachineCore::TStateBinding<ECharacterState::DefaultState, FShippingDefaultState>,
+//		StateMachineCore::TStateBinding<ECharacterState::Sliding, FShippingSliding>>;
+//	StateMachineCore::TStaticStateMachineContext<FShippingStateMachine, ACharacter> Context(Machine, Character);
+//	Machine.Detect(Context);
+//
+//Binding order is priority order for detection, the same as MechanicsHierarchy.
+
+#include "StateMachineCore.h"
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace StateMachineCore
+{
+	template <auto InEnum, typename InStateType>
+	struct TStateBinding
+	{
+		static constexpr auto Enum = InEnum;
+		using StateType = InStateType;
+	};
+
+	//TransitionTraits needs a static constexpr Table member, a TTransitionTable over the same enum as the bindings.
+	template <typename TransitionTraits, typename FirstBinding, typename... OtherBindings>
+	class TStaticStateMachine
+	{
+	public:
+		using EnumType = std::decay_t<decltype(FirstBinding::Enum)>;
+
+		static constexpr int NumStates = 1 + sizeof...(OtherBindings);
+
+		static constexpr bool CanTransition(const EnumType From, const EnumType To)
+		{
+			return TransitionTraits::Table.CanTransition(From, To);
+		}
+
+		void Bind(typename FirstBinding::StateType* First, typename OtherBindings::StateType*... Others)
+		{
+			States = FStateTuple(First, Others...);
+		}
+
+		EnumType GetCurrentEnumState() const { return CurrentEnum; }
+		bool HasCurrentState() const { return HasCurrent; }
+		bool ShouldRunUpdate() const { return HasCurrent && RunUpdate; }
+
+		template <typename ContextType>
+		ESetStateResult SetState(const EnumType NewState, ContextType& Context)
+		{
+			bool Bound = false;
+			const bool ConditionMet = Visit(NewState, [&Context, &Bound](auto& State)
+			{
+				using ConcreteType = std::decay_t<decltype(State)>;
+				Bound = true;
+				return State.ConcreteType::OnSetStateConditionCheck(Context);
+			});
+
+			if (!Bound) return ESetStateResult::Unassigned;
+			if (!ConditionMet) return ESetStateResult::ConditionFailed;
+
+			if (HasCurrent)
+			{
+				if (!CanTransition(CurrentEnum, NewState)) return ESetStateResult::Disallowed;
+
+				RunUpdate = false;
+				Visit(CurrentEnum, [&Context](auto& State)
+				{
+					using ConcreteType = std::decay_t<decltype(State)>;
+					State.ConcreteType::OnExitState(Context);
+					return true;
+				});
+			}
+
+			CurrentEnum = NewState;
+			HasCurrent = true;
+			Visit(NewState, [&Context](auto& State)
+			{
+				using ConcreteType = std::decay_t<decltype(State)>;
+				State.ConcreteType::OnEnterState(Context);
+				return true;
+			});
+			RunUpdate = true;
+			return ESetStateResult::Entered;
+		}
+
+		template <typename ContextType>
+		void Update(ContextType& Context)
+		{
+			if (!ShouldRunUpdate()) return;
+
+			Visit(CurrentEnum, [&Context](auto& State)
+			{
+				using ConcreteType = std::decay_t<decltype(State)>;
+				State.ConcreteType::OnUpdateState(Context);
+				return true;
+			});
+		}
+
+		//Walks the bindings in priority order and calls OverrideDetectState on every state enterable from the current one.
+		//Stops as soon as one of them switched state.
+		template <typename ContextType>
+		void Detect(ContextType& Context)
+		{
+			if (!HasCurrent) return;
+			DetectInOrder(Context, std::index_sequence_for<FirstBinding, OtherBindings...>());
+		}
+
+		//Runs Op on the current state's concrete type, for the per-frame override calls:
+		//	Machine.VisitCurrent([&](auto& State) { using T = std::decay_t<decltype(State)>; State.T::OverrideMovementInput(SM, Input); return true; });
+		template <typename OpType>
+		bool VisitCurrent(OpType&& Op)
+		{
+			return HasCurrent && Visit(CurrentEnum, Op);
+		}
+
+	private:
+		using FStateTuple = std::tuple<typename FirstBinding::StateType*, typename OtherBindings::StateType*...>;
+
+		template <std::size_t Index>
+		using TBindingAt = std::tuple_element_t<Index, std::tuple<FirstBinding, OtherBindings...>>;
+
+		//Calls Op on the state bound to Enum and returns its result. Returns false if nothing is bound to it.
+		template <typename OpType>
+		bool Visit(const EnumType Enum, OpType&& Op)
+		{
+			return VisitImpl(Enum, Op, std::index_sequence_for<FirstBinding, OtherBindings...>());
+		}
+
+		template <typename OpType, std::size_t... Indices>
+		bool VisitImpl(const EnumType Enum, OpType& Op, std::index_sequence<Indices...>)
+		{
+			bool Result = false;
+			((Enum == TBindingAt<Indices>::Enum ? (Result = Op(*std::get<Indices>(States)), true) : false) || ...);
+			return Result;
+		}
+
+		template <typename ContextType, std::size_t... Indices>
+		void DetectInOrder(ContextType& Context, std::index_sequence<Indices...>)
+		{
+			(DetectOne<Indices>(Context) || ...);
+		}
+
+		//Returns true if the detector switched state, which stops the fold.
+		template <std::size_t Index, typename ContextType>
+		bool DetectOne(ContextType& Context)
+		{
+			using FBinding = TBindingAt<Index>;
+			using ConcreteType = typename FBinding::StateType;
+
+			if (CurrentEnum == FBinding::Enum || !CanTransition(CurrentEnum, FBinding::Enum)) return false;
+
+			const EnumType StateBefore = CurrentEnum;
+			ConcreteType& State = *std::get<Index>(States);
+			State.ConcreteType::OverrideDetectState(Context);
+			return CurrentEnum != StateBefore;
+		}
+
+		FStateTuple States;
+		EnumType CurrentEnum = EnumType();
+		bool HasCurrent = false;
+		bool RunUpdate = false;
+	};
+
+	//What the states of a TStaticStateMachine are called with. SetState goes to the static machine, so a detector that switches
+	//through it stops Detect the way it does on the runtime machine. Owner is whatever the states act on, the character.
+	template <typename MachineType, typename OwnerType>
+	struct TStaticStateMachineContext
+	{
+		using EnumType = typename MachineType::EnumType;
+
+		TStaticStateMachineContext(MachineType& InMachine, OwnerType& InOwner) : Machine(InMachine), Owner(InOwner) {}
+
+		ESetStateResult SetState(const EnumType NewState) { return Machine.SetState(NewState, *this); }
+		EnumType GetCurrentEnumState() const { return Machine.GetCurrentEnumState(); }
+
+		MachineType& Machine;
+		OwnerType& Owner;
+	};
+}
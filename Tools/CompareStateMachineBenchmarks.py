@@ -0,0 +1,77 @@
+#!/usr/bin/env python3
+"""Compares two StateMachine.Benchmark result files and fails if the second one regressed.
+
+Both runs should replay the same recording into the same number of machines. Throughput may not drop, and latency and
+memory growth may not rise, by more than the tolerance.
+
+    python CompareStateMachineBenchmarks.py Saved/StateMachineBenchmarks/Baseline.json Saved/StateMachineBenchmarks/Current.json
+"""
+
+import argparse
+import json
+import sys
+
+VERSION = 3
+
+# (path in the results, True if higher is better)
+METRICS = [
+    (("throughput", "machine_frames_per_second"), True),
+    (("frame_time_us", "p99"), False),
+    (("latency_us", "p50"), False),
+    (("latency_us", "p99"), False),
+    (("latency_us", "p999"), False),
+    (("latency_frames", "p99"), False),
+    (("memory_growth", "used_physical_bytes"), False),
+    (("memory_growth", "machine_bytes"), False),
+]
+
+
+def read_results(path):
+    with open(path) as file:
+        results = json.load(file)
+    if results.get("version") != VERSION:
+        raise ValueError(f"{path} is version {results.get('version')}, this tool reads version {VERSION}")
+    return results
+
+
+def lookup(results, path):
+    for key in path:
+        results = results[key]
+    return results
+
+
+def compare(baseline, current, tolerance):
+    regressions = []
+    for path, higher_is_better in METRICS:
+        before, after = lookup(baseline, path), lookup(current, path)
+        # A baseline of zero, like a run without memory growth, fails on any rise.
+        limit = abs(before) * tolerance
+        change = before - after if higher_is_better else after - before
+        name = ".".join(path)
+        regressed = change > 0 and change > limit
+        print(f"{'REGRESSED' if regressed else 'ok':>9}  {name:<40} {before:>16.3f} -> {after:>16.3f}")
+        if regressed:
+            regressions.append(name)
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("baseline", help="results of the version to compare against")
+    parser.add_argument("current", help="results of the version under test")
+    parser.add_argument("-t", "--tolerance", type=float, default=0.1, help="allowed relative change, 0.1 by default")
+    arguments = parser.parse_args()
+
+    baseline, current = read_results(arguments.baseline), read_results(arguments.current)
+    for key in ("input", "machines", "frames"):
+        if baseline[key] != current[key]:
+            print(f"warning: {key} differs, {baseline[key]} against {current[key]}", file=sys.stderr)
+
+    regressions = compare(baseline, current, arguments.tolerance)
+    if regressions:
+        print(f"{len(regressions)} metric(s) regressed by more than {arguments.tolerance:.0%}", file=sys.stderr)
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
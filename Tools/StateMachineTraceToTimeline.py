@@ -0,0 +1,116 @@
+#!/usr/bin/env python3
+"""Converts a .smtrace dump from UCharacterStateMachine::DumpTransitionTrace into Chrome trace JSON.
+
+Open the output in chrome://tracing or https://ui.perfetto.dev. Each state shows up as an async span on the
+owner's track, as states of different regions overlap. Detectors and transitions are slices with their cost,
+requests and rejections are instants.
+
+    python StateMachineTraceToTimeline.py Saved/StateMachineTraces/BP_Player_C_0.smtrace -o timeline.json
+"""
+
+import argparse
+import json
+import struct
+import sys
+
+MAGIC = 0x52544D53
+VERSION = 1
+HEADER = struct.Struct("<IIIIdII")
+RECORD = struct.Struct("<QIBBBB")
+NO_STATE = 0xFF
+
+EVENT_TYPES = ["Transition", "Enter", "Exit", "Request", "RequestRejected", "Detector"]
+SET_STATE_RESULTS = ["Entered", "Unassigned", "ConditionFailed", "Disallowed", "Superseded", "Blocked"]
+
+
+def read_trace(path):
+    with open(path, "rb") as file:
+        data = file.read()
+
+    magic, version, record_size, num_records, seconds_per_cycle, num_states, owner_length = HEADER.unpack_from(data, 0)
+    if magic != MAGIC:
+        raise ValueError(f"{path} is not a state machine trace")
+    if version != VERSION or record_size != RECORD.size:
+        raise ValueError(f"{path} is version {version} with {record_size} byte records, this tool reads version {VERSION}")
+
+    offset = HEADER.size
+    owner = data[offset:offset + owner_length].decode("utf-8")
+    offset += owner_length
+
+    state_names = []
+    for _ in range(num_states):
+        length = data[offset]
+        state_names.append(data[offset + 1:offset + 1 + length].decode("utf-8"))
+        offset += 1 + length
+
+    records = [RECORD.unpack_from(data, offset + index * RECORD.size) for index in range(num_records)]
+    return owner, state_names, seconds_per_cycle, records
+
+
+def to_chrome_trace(owner, state_names, seconds_per_cycle, records):
+    def state_name(index):
+        if index == NO_STATE:
+            return "None"
+        return state_names[index] if index < len(state_names) else f"State {index}"
+
+    def micros(cycles):
+        return cycles * seconds_per_cycle * 1e6
+
+    events = [{"ph": "M", "name": "thread_name", "pid": 0, "tid": 0, "args": {"name": owner}}]
+    if not records:
+        return events
+
+    start = records[0][0]
+    open_states = set()
+    for timestamp, payload, event_type, source, target, result in records:
+        time = micros(timestamp - start)
+        name = EVENT_TYPES[event_type] if event_type < len(EVENT_TYPES) else f"Event {event_type}"
+
+        if name == "Enter":
+            open_states.add(source)
+            events.append({"ph": "b", "name": state_name(source), "cat": "State", "id": source, "ts": time, "pid": 0, "tid": 0})
+        elif name == "Exit":
+            # The buffer may have wrapped past the matching Enter, only close spans that were opened.
+            if source in open_states:
+                events.append({"ph": "e", "name": state_name(source), "cat": "State", "id": source, "ts": time, "pid": 0, "tid": 0})
+                open_states.discard(source)
+        elif name in ("Transition", "Detector"):
+            args = {"from": state_name(source), "to": state_name(target)}
+            if name == "Transition":
+                args["result"] = SET_STATE_RESULTS[result] if result < len(SET_STATE_RESULTS) else result
+            duration = micros(payload)
+            events.append({"ph": "X", "name": f"{name} {state_name(target)}", "cat": name, "ts": time - duration,
+                           "dur": duration, "pid": 0, "tid": 1, "args": args})
+        else:
+            args = {"from": state_name(source), "to": state_name(target)}
+            if name == "RequestRejected":
+                args["reason"] = SET_STATE_RESULTS[result] if result < len(SET_STATE_RESULTS) else result
+            events.append({"ph": "i", "s": "t", "name": f"{name} {state_name(target)}", "cat": name, "ts": time,
+                           "pid": 0, "tid": 1, "args": args})
+
+    last = micros(records[-1][0] - start)
+    for state in sorted(open_states):
+        events.append({"ph": "e", "name": state_name(state), "cat": "State", "id": state, "ts": last, "pid": 0, "tid": 0})
+
+    events.append({"ph": "M", "name": "thread_name", "pid": 0, "tid": 1, "args": {"name": owner + " transitions"}})
+    return events
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("trace", help=".smtrace file written by DumpTransitionTrace or StateMachine.DumpTraces")
+    parser.add_argument("-o", "--output", help="output JSON file, defaults to stdout")
+    arguments = parser.parse_args()
+
+    owner, state_names, seconds_per_cycle, records = read_trace(arguments.trace)
+    timeline = {"traceEvents": to_chrome_trace(owner, state_names, seconds_per_cycle, records), "displayTimeUnit": "ms"}
+
+    if arguments.output:
+        with open(arguments.output, "w") as file:
+            json.dump(timeline, file)
+    else:
+        json.dump(timeline, sys.stdout)
+
+
+if __name__ == "__main__":
+    main()